@@ -1,3 +1,6 @@
+include(CMakeFindDependencyMacro)
+find_dependency(Threads)   # Named by the exported targets' link interface
+
 include("${CMAKE_CURRENT_LIST_DIR}/biosignalmlTargets.cmake")
 
 GET_FILENAME_COMPONENT (SELF_DIR "${CMAKE_CURRENT_LIST_FILE}" PATH)
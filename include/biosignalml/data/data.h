@@ -26,6 +26,9 @@
 #include <biosignalml/signal.h>
 
 #include <stdexcept>
+#include <string>
+#include <vector>
+#include <unordered_map>
 
 
 namespace bsml {
@@ -57,11 +60,78 @@ namespace bsml {
         (void)length ;
         }
 
+      typedef std::vector<typename SIGNAL_TYPE::Ptr> Signals ;
+
+      //! Signals added or removed with these members have their positions recorded
+      //! for `index()` and `operator[]`. Call `index_signals()` after changing the
+      //! array in any other way, such as by assigning to an element.
+      void push_back(const typename SIGNAL_TYPE::Ptr &signal)
+      {
+        Signals::push_back(signal) ;
+        if (signal != nullptr) m_positions.emplace(signal->uri().to_string(), this->size() - 1) ;
+        }
+
+      typename Signals::iterator insert(typename Signals::const_iterator pos, const typename SIGNAL_TYPE::Ptr &signal)
+      {
+        auto inserted = Signals::insert(pos, signal) ;
+        index_signals() ;
+        return inserted ;
+        }
+
+      typename Signals::iterator erase(typename Signals::const_iterator pos)
+      {
+        auto next = Signals::erase(pos) ;
+        index_signals() ;
+        return next ;
+        }
+
+      typename Signals::iterator erase(typename Signals::const_iterator first, typename Signals::const_iterator last)
+      {
+        auto next = Signals::erase(first, last) ;
+        index_signals() ;
+        return next ;
+        }
+
+      void pop_back(void)
+      {
+        Signals::pop_back() ;
+        index_signals() ;
+        }
+
+      void clear(void)
+      {
+        Signals::clear() ;
+        m_positions.clear() ;
+        }
+
+      //! Record each signal's position in the array.
+      void index_signals(void)
+      {
+        m_positions.clear() ;
+        m_positions.reserve(this->size()) ;
+        for (size_t n = 0 ;  n < this->size() ;  ++n) {
+          if ((*this)[n] != nullptr) m_positions.emplace((*this)[n]->uri().to_string(), n) ;
+          }
+        }
+
+      //! The position of the signal with `uri` in the array, or -1 if it isn't present.
       virtual int index(const std::string &uri) const
       {
-        (void)uri ;        // Unused parameter
-        return -1 ;
+        auto p = m_positions.find(uri) ;
+        return (p == m_positions.end()) ? -1 : (int)p->second ;
         }
+
+      using Signals::operator[] ;
+
+      //! The signal with `uri`, or `nullptr` if it isn't in the array.
+      typename SIGNAL_TYPE::Ptr operator[](const std::string &uri) const
+      {
+        auto p = m_positions.find(uri) ;
+        return (p == m_positions.end()) ? nullptr : (*this)[p->second] ;
+        }
+
+     private:
+      std::unordered_map<std::string, size_t> m_positions ;
       } ;
 
 
@@ -23,11 +23,15 @@
 
 #include <biosignalml/biosignalml_export.h>
 #include <biosignalml/data/data.h>
+#include <biosignalml/data/statistics.h>
 #include <biosignalml/biosignalml.h>
 
 #include <string>
+#include <cstdint>
 #include <memory>
 #include <list>
+#include <vector>
+#include <functional>
 
 #if defined(_MSC_VER)
 #include <BaseTsd.h>
@@ -45,7 +49,101 @@ namespace bsml {
     enum H5Compression {
       BSML_H5_COMPRESS_NONE,
       BSML_H5_COMPRESS_GZIP,
-      BSML_H5_COMPRESS_SZIP
+      BSML_H5_COMPRESS_SZIP,
+      BSML_H5_COMPRESS_LZ4,     // These need the filter's HDF5 plugin to be installed
+      BSML_H5_COMPRESS_ZSTD,
+      BSML_H5_COMPRESS_BLOSC
+      } ;
+
+    enum H5BufferUnits {
+      BSML_H5_BUFFER_SAMPLES,
+      BSML_H5_BUFFER_BYTES
+      } ;
+
+
+    enum H5Datatype {
+      BSML_H5_FLOAT64,
+      BSML_H5_FLOAT32,
+      BSML_H5_INT32,
+      BSML_H5_INT16
+      } ;
+
+    enum H5ChunkLayout {
+      BSML_H5_CHUNK_AUTO,       // Whole rows, unless they are too wide for a useful number of rows
+      BSML_H5_CHUNK_WINDOW,     // Whole rows, for reading all channels over a time window
+      BSML_H5_CHUNK_CHANNEL     // A single channel, for reading one channel over a long duration
+      } ;
+
+    //! How a dataset's points are stored on file. Options are recorded in the
+    //! dataset's filter pipeline and layout, so can be recovered when the file is read.
+    class BIOSIGNALML_EXPORT StorageOptions
+    /*-----------------------------------*/
+    {
+     public:
+      StorageOptions(H5Compression compression=BSML_H5_COMPRESS_GZIP, int level=-1, bool shuffle=false)
+      : compression(compression), level(level), shuffle(shuffle),
+        layout(BSML_H5_CHUNK_AUTO), chunk_bytes(0),
+        datatype(BSML_H5_FLOAT64), gain(1.0), offset(0.0),
+        pyramid_levels(0), pyramid_factor(16), chunk_summaries(false) { }
+
+      H5Compression compression ;
+      int level ;       // Compression level, or -1 for the codec's default
+      bool shuffle ;    // Byte-shuffle points before compressing them
+      H5ChunkLayout layout ;
+      size_t chunk_bytes ;              // Target size of a chunk, or 0 for the default
+      std::vector<size_t> chunk_shape ; // Explicit chunk dimensions, overriding `layout`
+      //! Points are stored as `datatype`, with a physical value
+      //! being `gain*stored + offset`. Appending NaN to a signal stored
+      //! as integers throws `HDF5::Exception`.
+      H5Datatype datatype ;
+      double gain ;
+      double offset ;
+      //! A signal can keep a pyramid of summaries of its points, each row of
+      //! a level having the minimum, maximum and mean of `pyramid_factor`
+      //! rows of the level below, for reading overviews of long recordings.
+      size_t pyramid_levels ;   // 0 for no pyramid
+      size_t pyramid_factor ;
+      //! Keep the count, extremes, sum and sum of squares of each chunk of
+      //! a signal's points, so its statistics over long ranges are found
+      //! without reading every point.
+      bool chunk_summaries ;
+      } ;
+
+
+    //! Parameters for HDF5's raw data chunk cache, which each open dataset has.
+    class BIOSIGNALML_EXPORT ChunkCache
+    /*-------------------------------*/
+    {
+     public:
+      ChunkCache(size_t bytes=0, size_t slots=0, double preemption=0.75)
+      : bytes(bytes), slots(slots), preemption(preemption) { }
+
+      size_t bytes ;        // Size of the cache, or 0 for HDF5's default
+      size_t slots ;        // Hash table slots, or 0 to choose from `bytes`
+      double preemption ;   // Preference, from 0 to 1, for evicting chunks that have been fully read
+      } ;
+
+    //! Given an error that can't be thrown, such as failing to write buffered
+    //! points as a dataset is destroyed. A handler mustn't throw.
+    using ErrorHandler = std::function<void(const std::string &error)> ;
+
+    //! An estimate of the chunk cache hits and misses made when reading a
+    //! dataset. HDF5 doesn't report these, so they are modelled by following
+    //! the chunks each read touches through a least-recently-used cache of
+    //! as many whole chunks as the configured `ChunkCache::bytes` holds. The
+    //! model ignores HDF5's hashing of chunks into `slots` (where two chunks
+    //! sharing a slot evict each other) and its `w0` preemption policy, and
+    //! doesn't see chunks brought in by writes, so the real cache may miss
+    //! more often than estimated. Use the counts to compare access patterns
+    //! and cache sizes rather than as exact measurements.
+    class BIOSIGNALML_EXPORT CacheStatistics
+    /*------------------------------------*/
+    {
+     public:
+      CacheStatistics() : hits(0), misses(0) { }
+
+      size_t hits ;
+      size_t misses ;
       } ;
 
 
@@ -53,9 +151,11 @@ namespace bsml {
     class Dataset ;     // Declare forward
     class ClockData ;   // Declare forward
     class SignalData ;  // Declare forward
+    class AsyncWriter ; // Declare forward
 
     class Recording ;   // VS2013 needs class visible for friendship...
     class Signal ;      // VS2013 needs class visible for friendship...
+    class SignalArray ; // VS2013 needs class visible for friendship...
 
     class IOError : public data::Exception
     /*----------------------------------*/
@@ -84,12 +184,24 @@ namespace bsml {
       //! not less than `t`.
       size_t index(const double t) const override ;
       size_t index_right(const double t) const override ;
+      //! Find both `index_right(start)` and `index(end)` together,
+      //! i.e. the first and last points of the closed interval `[start, end]`.
+      std::pair<size_t, ssize_t> index_range(const double start, const double end) const ;
+      //! Limit the memory used to cache blocks of times read from file.
+      void set_cache_size(size_t bytes) ;
+      //! Limit the memory used by the clock's sparse time index.
+      void set_index_size(size_t bytes) ;
+      //! Rebuild the clock's saved time index by reading its times.
+      void rebuild_index(void) ;
       void extend(const double *times, const size_t length) override ;
       std::vector<double> read(size_t pos=0, ssize_t length=-1) override ;
+      //! Read up to `length` times into `times`, returning the number read.
+      size_t read(size_t pos, size_t length, double *times) ;
 
      private:
       std::shared_ptr<ClockData> m_data ;
       friend class Signal ;
+      friend class SignalArray ;
       friend class Recording ;
       } ;
 
@@ -104,10 +216,81 @@ namespace bsml {
       Signal(const rdf::URI &uri, const rdf::URI &units, double rate) ;
       Signal(const rdf::URI &uri, const rdf::URI &units, Clock::Ptr clock) ;
       void extend(const double *points, const size_t length) override ;
+      //! Append raw values, to be stored without applying gain and offset.
+      void extend(const int16_t *points, const size_t length) ;
+      void extend(const int32_t *points, const size_t length) ;
+      //! Buffer appended points, writing them in chunk-aligned blocks of at
+      //! least `size` samples (or bytes). A `size` of zero disables buffering.
+      void set_append_buffer(size_t size, H5BufferUnits units=BSML_H5_BUFFER_SAMPLES) ;
       //! Read all points spanned by the closed interval (i.e. include points at start
-      //! and end of interval.
+      //! and end of interval. If the interval has more than `maxpoints` points they
+      //! are decimated, with each bin of points giving its minimum at the time of its
+      //! first point and its maximum at the time of its middle point (or, when
+      //! `maxpoints` is 1, a single bin's mean). Only a signal with a pyramid avoids
+      //! reading every point.
       data::TimeSeries::Ptr read(Interval::Ptr interval, ssize_t maxpoints=-1) override ;
       data::TimeSeries::Ptr read(size_t pos=0, ssize_t length=-1) override ;
+      //! Summarise the points spanned by the closed interval in at most `maxbins`
+      //! bins, as channels of the minimum, maximum and mean of each bin's points,
+      //! timed by its first point. Only a signal with a pyramid avoids reading
+      //! every point.
+      data::MultiTimeSeries::Ptr read_envelope(Interval::Ptr interval, size_t maxbins) ;
+      //! Filter and decimate the points of a uniformly sampled signal a block of
+      //! chunks at a time, reading points either side of the interval when the
+      //! filter needs them.
+      data::UniformTimeSeries::Ptr read_decimated(Interval::Ptr interval, double rate) override ;
+      data::UniformTimeSeries::Ptr read_resampled(Interval::Ptr interval, double rate,
+        data::Interpolation method=data::Interpolation::LINEAR) override ;
+      //! Statistics of the points spanned by the closed interval, or of up to
+      //! `length` points from `pos`. A signal with chunk summaries only reads
+      //! the points in partial chunks at either end, otherwise every point is
+      //! read a block of chunks at a time.
+      data::Statistics statistics(Interval::Ptr interval) ;
+      data::Statistics statistics(size_t pos=0, ssize_t length=-1) ;
+      //! The `p`th percentile of the points spanned by the closed interval,
+      //! found with a few passes over them instead of holding them all.
+      double percentile(Interval::Ptr interval, double p) ;
+      //! Read up to `length` points directly into `points` (and their times
+      //! into `times` if given), returning the number of points read.
+      size_t read(size_t pos, size_t length, double *points, double *times=nullptr) ;
+      //! Read up to `length` points into `points`, and the times of a clocked
+      //! signal's points into `times`, returning a view of what was read.
+      data::TimeSeriesView read_view(size_t pos, size_t length, double *points, double *times=nullptr) ;
+      //! Read up to `length` raw values, without applying gain and offset,
+      //! from a signal stored as integers.
+      size_t read(size_t pos, size_t length, int16_t *points) ;
+      size_t read(size_t pos, size_t length, int32_t *points) ;
+      //! How the signal's points are stored on file.
+      StorageOptions storage_options(void) const ;
+      //! Use a chunk cache for the signal that differs from the recording's.
+      void set_chunk_cache(const ChunkCache &cache) ;
+      //! The estimated chunk cache hits and misses of reading the signal
+      //! (see `CacheStatistics`).
+      CacheStatistics cache_statistics(void) const ;
+
+      //! Follows a signal as it's written, returning just the points
+      //! appended since the previous poll.
+      class BIOSIGNALML_EXPORT Cursor
+      /*---------------------------*/
+      {
+       public:
+        //! The points (and their times) appended since the last poll, if any.
+        data::TimeSeries::Ptr poll(void) ;
+        //! Wait up to `timeout` seconds for points to be appended.
+        data::TimeSeries::Ptr poll(double timeout) ;
+        //! The position of the next point to be returned.
+        size_t position(void) const ;
+
+       private:
+        Cursor(std::shared_ptr<SignalData> data, std::shared_ptr<ClockData> clock, double rate, size_t pos) ;
+        std::shared_ptr<SignalData> m_data ;
+        std::shared_ptr<ClockData> m_clock ;
+        double m_rate ;
+        size_t m_position ;
+        friend class Signal ;
+        } ;
+      //! Follow the signal from point `pos`.
+      Cursor cursor(size_t pos=0) ;
 
      private:
       std::shared_ptr<SignalData> m_data ;
@@ -128,7 +311,47 @@ namespace bsml {
         }
 
       void extend(const double *points, const size_t length) ;
-      int index(const std::string &uri) const ;
+      void extend(const int16_t *points, const size_t length) ;
+      void extend(const int32_t *points, const size_t length) ;
+      //! Append `length` points to each signal, given as one buffer per signal.
+      void extend(const double *const *points, const size_t length) ;
+      void set_append_buffer(size_t size, H5BufferUnits units=BSML_H5_BUFFER_SAMPLES) ;
+      //! Read up to `length` points of each signal into one buffer per signal,
+      //! returning the number of points read.
+      size_t read(size_t pos, size_t length, double *const *points) ;
+      //! Read every channel's points in a single pass over the array's dataset,
+      //! either interleaved as stored or de-interleaved into channel-major order.
+      data::MultiTimeSeries::Ptr read(size_t pos=0, ssize_t length=-1,
+        data::MultiTimeSeries::Layout layout=data::MultiTimeSeries::Layout::INTERLEAVED) ;
+      //! Read every channel's points spanned by the closed interval, decimated
+      //! as a signal's are when there are more than `maxpoints`.
+      data::MultiTimeSeries::Ptr read(Interval::Ptr interval, ssize_t maxpoints=-1,
+        data::MultiTimeSeries::Layout layout=data::MultiTimeSeries::Layout::INTERLEAVED) ;
+      StorageOptions storage_options(void) const ;
+      void set_chunk_cache(const ChunkCache &cache) ;
+      CacheStatistics cache_statistics(void) const ;
+
+      //! Follows a signal array as it's written, returning the interleaved
+      //! points of every channel appended since the previous poll.
+      class BIOSIGNALML_EXPORT Cursor
+      /*---------------------------*/
+      {
+       public:
+        data::MultiTimeSeries::Ptr poll(void) ;
+        data::MultiTimeSeries::Ptr poll(double timeout) ;
+        size_t position(void) const ;
+
+       private:
+        Cursor(std::shared_ptr<SignalData> data, std::shared_ptr<ClockData> clock,
+               double rate, size_t channels, size_t pos) ;
+        std::shared_ptr<SignalData> m_data ;
+        std::shared_ptr<ClockData> m_clock ;
+        double m_rate ;
+        size_t m_channels ;
+        size_t m_position ;
+        friend class SignalArray ;
+        } ;
+      Cursor cursor(size_t pos=0) ;
 
      private:
       std::shared_ptr<SignalData> m_data ;
@@ -146,10 +369,56 @@ namespace bsml {
       RESOURCE(BSML::recording, Signal)
 
      public:
-      Recording(const rdf::URI &uri, const std::string &filename, bool create=false) ;
-      Recording(const std::string &filename, bool readonly=false) ;
-
+      //! The `cache` is used for the chunks of each of the recording's datasets.
+      //! A recording created with `swmr` can later be read while it's written,
+      //! once `start_swmr_write()` has been called.
+      Recording(const rdf::URI &uri, const std::string &filename, bool create=false,
+                const ChunkCache &cache=ChunkCache(), bool swmr=false) ;
+      //! With `swmr` a `readonly` recording is read while another process writes
+      //! it, with points appended by the writer seen as they are read.
+      Recording(const std::string &filename, bool readonly=false,
+                const ChunkCache &cache=ChunkCache(), bool swmr=false) ;
+
+      //! Write all buffered data and close the file. Call `close()` (or `flush()`)
+      //! to see errors writing buffered data, as a recording destroyed without
+      //! being closed can only pass them to its error handler.
       void close(void) override ;
+      //! Write all buffered data to the file.
+      void flush(void) ;
+      //! Set the append buffer size used by all signals and clocks in the
+      //! recording, including those subsequently created.
+      void set_append_buffer(size_t size, H5BufferUnits units=BSML_H5_BUFFER_SAMPLES) ;
+      //! Set how signals and clocks subsequently created in the recording are stored.
+      void set_storage_options(const StorageOptions &options) ;
+      //! The estimated chunk cache hits and misses of all the recording's
+      //! datasets (see `CacheStatistics`).
+      CacheStatistics cache_statistics(void) const ;
+      //! Write appended points on a background thread, queueing up to `length`
+      //! appends and blocking further appends while the queue is full. A write
+      //! error is thrown by the next append, `sync()` or `close()`. A `length`
+      //! of zero stops the thread, so appends are written by the caller again.
+      //! While writes are asynchronous, appends must all be made from one
+      //! thread; one made from any other thread throws `HDF5::Exception`.
+      void set_async_writes(size_t length) ;
+      //! Wait until all queued appends have been written.
+      void sync(void) ;
+      //! Pass `handler` the errors writing buffered points when the recording's
+      //! signals and clocks are destroyed without it being closed. Without a
+      //! handler these errors are lost.
+      void set_error_handler(ErrorHandler handler) ;
+      //! Don't flush the file as each signal or clock is created, leaving
+      //! this to `flush()` or `close()`.
+      void set_deferred_durability(bool defer) ;
+      //! Define signals and clocks as a batch, with the file flushed just once,
+      //! at the matching `end_definitions()`. Batches may be nested.
+      void begin_definitions(void) ;
+      void end_definitions(void) ;
+      //! Let readers open the recording while it's being written. All signals
+      //! and clocks must have been defined, as no more can be created. Points
+      //! appended are visible to readers after each `flush()`.
+      void start_swmr_write(void) ;
+      //! Re-read the extent of every dataset, to see points since appended.
+      void refresh(void) ;
 
       Clock::Ptr get_clock(const rdf::URI &uri) ;
       Clock::Ptr get_clock(const std::string &uri) ;
@@ -158,22 +427,55 @@ namespace bsml {
       Signal::Ptr get_signal(const rdf::URI &uri) ;
       Signal::Ptr get_signal(const std::string &uri) ;
       std::list<rdf::URI> get_signal_uris(void) ;
+      //! Read points of the signals named by `uris`, in that order. Signals in
+      //! the same compound dataset are read together, with a single selection.
+      std::vector<data::TimeSeries::Ptr> read_signals(const std::vector<std::string> &uris,
+                                                      size_t pos=0, ssize_t length=-1) ;
+      //! Signals spanning more than `maxpoints` points of the interval are decimated,
+      //! as by `Signal::read()`, with those sharing a dataset binned in one pass.
+      std::vector<data::TimeSeries::Ptr> read_signals(const std::vector<std::string> &uris,
+                                                      Interval::Ptr interval, ssize_t maxpoints=-1) ;
 
       Clock::Ptr new_clock(const std::string &uri, const rdf::URI &units,
                                  double *times = nullptr, size_t datasize=0) ;
 
       Signal::Ptr new_signal(const std::string &uri, const rdf::URI &units, double rate) ;
       Signal::Ptr new_signal(const std::string &uri, const rdf::URI &units, Clock::Ptr clock) ;
+      Signal::Ptr new_signal(const std::string &uri, const rdf::URI &units, double rate,
+                             const StorageOptions &options) ;
+      Signal::Ptr new_signal(const std::string &uri, const rdf::URI &units, Clock::Ptr clock,
+                             const StorageOptions &options) ;
 
       SignalArray::Ptr new_signalarray(const std::vector<std::string> &uris,
                                        const std::vector<rdf::URI> &units, double rate) ;
       SignalArray::Ptr new_signalarray(const std::vector<std::string> &uris,
                                        const std::vector<rdf::URI> &units, Clock::Ptr clock) ;
+      SignalArray::Ptr new_signalarray(const std::vector<std::string> &uris,
+                                       const std::vector<rdf::URI> &units, double rate,
+                                       const StorageOptions &options) ;
+      SignalArray::Ptr new_signalarray(const std::vector<std::string> &uris,
+                                       const std::vector<rdf::URI> &units, Clock::Ptr clock,
+                                       const StorageOptions &options) ;
 // Variants of new_signal() with rate/period (== regular Clock)
 
      private:
+      void add_dataset(std::shared_ptr<Dataset> dataset) ;
+      void stop_writer(void) ;
+      void defer_flushes(void) ;
+      void check_definable(void) ;
+      std::vector<data::TimeSeries::Ptr> read_signals(const std::vector<std::string> &uris,
+                                                      Interval::Ptr interval, size_t pos, ssize_t length) ;
+
       File *m_file ;
       bool m_readonly ;
+      size_t m_buffer_size = 0 ;
+      H5BufferUnits m_buffer_units = BSML_H5_BUFFER_SAMPLES ;
+      StorageOptions m_storage ;
+      std::shared_ptr<AsyncWriter> m_writer ;
+      ErrorHandler m_error_handler ;
+      bool m_deferred = false ;
+      int m_definitions = 0 ;
+      bool m_swmr = false ;
       std::set<std::shared_ptr<Dataset>> datasets ;
       } ;
 
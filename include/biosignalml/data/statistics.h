@@ -0,0 +1,97 @@
+/******************************************************************************
+ *                                                                            *
+ *  BioSignalML Management in C++                                             *
+ *                                                                            *
+ *  Copyright (c) 2010-2015  David Brooks                                     *
+ *                                                                            *
+ *  Licensed under the Apache License, Version 2.0 (the "License");           *
+ *  you may not use this file except in compliance with the License.          *
+ *  You may obtain a copy of the License at                                   *
+ *                                                                            *
+ *      http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                            *
+ *  Unless required by applicable law or agreed to in writing, software       *
+ *  distributed under the License is distributed on an "AS IS" BASIS,         *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ *  See the License for the specific language governing permissions and       *
+ *  limitations under the License.                                            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef BSML_DATA_STATISTICS_H
+#define BSML_DATA_STATISTICS_H
+
+#include <biosignalml/biosignalml_export.h>
+#include <biosignalml/data/timeseries.h>
+
+#include <cstddef>
+#include <functional>
+
+
+namespace bsml {
+
+  namespace data {
+
+    //! The count, extremes, mean and spread of a set of values, accumulated
+    //! a block at a time. Statistics of separate sets can be merged, so
+    //! those of windows combine into those of a longer interval.
+    class BIOSIGNALML_EXPORT Statistics
+    /*-------------------------------*/
+    {
+     public:
+      Statistics() ;
+      //! Statistics of `count` values with the given extremes, sum and sum
+      //! of squares.
+      Statistics(size_t count, double min, double max, double sum, double sumsq) ;
+
+      //! Include `count` more values.
+      void add(const double *values, const size_t count) ;
+      //! Include the values that `other` summarises.
+      void merge(const Statistics &other) ;
+
+      inline size_t count(void) const { return m_count ; }
+      //! The extremes and mean are NaN when there are no values.
+      double min(void) const ;
+      double max(void) const ;
+      double mean(void) const ;
+      //! The population variance, i.e. about the mean and divided by `count()`.
+      double variance(void) const ;
+      double standard_deviation(void) const ;
+      //! The root mean square of the values.
+      double rms(void) const ;
+
+     private:
+      size_t m_count ;
+      double m_min ;
+      double m_max ;
+      double m_mean ;
+      double m_m2 ;     // Sum of squared differences from the mean
+      } ;
+
+
+    //! Reads up to `length` values from position `pos` into `buffer`,
+    //! returning the number of values read.
+    typedef std::function<size_t(size_t pos, size_t length, double *buffer)> ValueReader ;
+
+    BIOSIGNALML_EXPORT Statistics statistics(const double *values, const size_t count) ;
+    BIOSIGNALML_EXPORT Statistics statistics(const TimeSeriesView &series) ;
+    BIOSIGNALML_EXPORT Statistics statistics(const TimeSeries &series) ;
+    //! Statistics of `count` values from `reader`, read `block` values at a time.
+    BIOSIGNALML_EXPORT Statistics statistics(const ValueReader &reader, const size_t count, const size_t block) ;
+
+    //! The `p`th percentile (from 0 to 100) of the values, interpolating
+    //! between the two nearest ranks. It's found by selection, in linear time.
+    BIOSIGNALML_EXPORT double percentile(const double *values, const size_t count, const double p) ;
+    BIOSIGNALML_EXPORT double percentile(const TimeSeriesView &series, const double p) ;
+    BIOSIGNALML_EXPORT double percentile(const TimeSeries &series, const double p) ;
+    //! The `p`th percentile of `count` values from `reader`, read `block` values
+    //! at a time. Each pass over the values narrows the range of those that
+    //! could be the percentile until at most `block` remain to select from.
+    BIOSIGNALML_EXPORT double percentile(const ValueReader &reader, const size_t count, const double p,
+                                         const size_t block) ;
+
+    } ;
+
+  } ;
+
+#endif
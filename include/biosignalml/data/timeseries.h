@@ -36,13 +36,17 @@ namespace bsml {
 
   namespace data {
 
+    //! How values between points are found when a time series is resampled.
+    enum class Interpolation { NEAREST, LINEAR } ;
+
+    //! A time and value, as a plain value type that is trivially
+    //! copied and destroyed.
     class BIOSIGNALML_EXPORT Point
     /*--------------------------*/
     {
      public:
       Point() : m_time(NAN), m_data(NAN) { }
       Point(double t, double x) : m_time(t), m_data(x) { }
-      virtual ~Point() = default ;
 
       double time(void) const { return m_time ; }
       double value(void) const { return m_data ; }
@@ -53,6 +57,83 @@ namespace bsml {
       } ;
 
 
+    //! A sequence of time points held elsewhere, in a time series or a caller's
+    //! buffer, which must outlive the view. Points are timed either by a rate and
+    //! start time or by a parallel array of times. Views are cheap to copy and
+    //! slicing one neither allocates nor copies points.
+    class BIOSIGNALML_EXPORT TimeSeriesView
+    /*-----------------------------------*/
+    {
+     public:
+      TimeSeriesView() ;
+      //! Points sampled at `rate`, starting at time `start`.
+      TimeSeriesView(const double *data, const size_t size, const double rate, const double start=0.0) ;
+      //! Points at the given `times`.
+      TimeSeriesView(const double *data, const size_t size, const double *times) ;
+
+      inline size_t size(void) const { return m_size ; }
+      inline const double *data(void) const { return m_data ; }
+      //! The points' times, or `nullptr` if they are uniformly sampled.
+      inline const double *times(void) const { return m_times ; }
+      inline bool uniform(void) const { return m_times == nullptr ; }
+      inline double rate(void) const { return m_rate ; }
+      inline double value(const size_t n) const { return m_data[n] ; }
+      inline double time(const size_t n) const {
+        return (m_times != nullptr) ? m_times[n] : m_start + (double)n/m_rate ;
+        }
+      inline Point point(const size_t n) const { return Point(time(n), m_data[n]) ; }
+      double duration(void) const ;
+      //! Find largest `n` such that `time(n) <= t`. Return `-1` if `t`
+      //! is before the start of the view.
+      ssize_t index(const double t) const ;
+      //! Find smallest `n` such that `time(n) >= t`. Return `size()` if `t`
+      //! is after the end of the view.
+      size_t index_right(const double t) const ;
+      //! Find `index()` for each of `count` times. Ascending times are found
+      //! by searching onwards from the previous time's position.
+      void index(const double *times, const size_t count, ssize_t *indices) const ;
+      void index_right(const double *times, const size_t count, size_t *indices) const ;
+      //! A view of up to `length` points from `pos`, or of all points
+      //! from `pos` if `length` is negative.
+      TimeSeriesView slice(const size_t pos, const ssize_t length=-1) const ;
+      //! Copy the times of points `begin` up to `end` into `times`.
+      void times(const size_t begin, const size_t end, double *times) const ;
+
+      class Iterator ;
+      Iterator begin(void) const ;
+      Iterator end(void) const ;
+
+     private:
+      size_t search(const double t, const bool upper, const size_t hint) const ;
+
+      const double *m_data ;
+      const double *m_times ;
+      size_t m_size ;
+      double m_rate ;
+      double m_start ;
+      } ;
+
+
+    //! Steps through a view's points without virtual calls.
+    class TimeSeriesView::Iterator
+    /*--------------------------*/
+    {
+     public:
+      Iterator(const TimeSeriesView &view, const size_t n) : m_view(view), m_n(n) { }
+      inline Point operator*(void) const { return m_view.point(m_n) ; }
+      inline Iterator &operator++(void) { ++m_n ; return *this ; }
+      inline bool operator==(const Iterator &other) const { return m_n == other.m_n ; }
+      inline bool operator!=(const Iterator &other) const { return m_n != other.m_n ; }
+
+     private:
+      TimeSeriesView m_view ;
+      size_t m_n ;
+      } ;
+
+    inline TimeSeriesView::Iterator TimeSeriesView::begin(void) const { return Iterator(*this, 0) ; }
+    inline TimeSeriesView::Iterator TimeSeriesView::end(void) const { return Iterator(*this, m_size) ; }
+
+
     //! A sequence of time points.
     //!
     //! Points are accessed via the `time()` method using a 0-origin index.
@@ -73,6 +154,8 @@ namespace bsml {
       TimeSeries() ;
       TimeSeries(const size_t size) ;
       TimeSeries(const std::vector<double> &times, const std::vector<double> &data) ;
+      //! Take ownership of `times` and `data` without copying.
+      TimeSeries(std::vector<double> &&times, std::vector<double> &&data) ;
       virtual ~TimeSeries() = default ;
 
       inline size_t size(void) const { return m_data.size() ; }
@@ -83,7 +166,25 @@ namespace bsml {
       //! Find largest `n` such that `time(n) <= t`. Return `-1` if `t`
       //! is before the start of the time series.
       virtual ssize_t index(const double t) ;
+      //! Find smallest `n` such that `time(n) >= t`. Return `size()` if `t`
+      //! is after the end of the time series.
+      size_t index_right(const double t) const ;
+      //! Find `index()` for each of `count` times, quickest when they are ascending.
+      void index(const double *times, const size_t count, ssize_t *indices) const ;
+      void index_right(const double *times, const size_t count, size_t *indices) const ;
       double duration(void) const ;
+      //! A view of up to `length` points from `pos` that refers to the
+      //! series' own points.
+      TimeSeriesView view(const size_t pos=0, const ssize_t length=-1) const ;
+      //! Copy the times of points `begin` up to `end` into `times`, computing
+      //! them in one pass for a uniformly sampled series.
+      void times(const size_t begin, const size_t end, double *times) const ;
+      //! Copy the values of points `begin` up to `end` into `values`.
+      void values(const size_t begin, const size_t end, double *values) const ;
+      //! Iterate over the points, e.g. with `for (auto const &p : *series)`,
+      //! without a virtual call for each point.
+      inline TimeSeriesView::Iterator begin(void) const { return view().begin() ; }
+      inline TimeSeriesView::Iterator end(void) const { return view().end() ; }
 
       // std::vector<Point> points(void) { return Point(m_times[n], m_data[n]) ; }
       // Can we use std::valarray<double> ??
@@ -91,6 +192,8 @@ namespace bsml {
      protected:
       std::vector<double> m_times ;
       std::vector<double> m_data ;
+      double m_rate ;     // Zero unless points are uniformly sampled
+      double m_start ;
       } ;
 
 
@@ -102,12 +205,51 @@ namespace bsml {
       UniformTimeSeries() ;
       UniformTimeSeries(const double rate, const size_t size, const double start=0.0) ;
       UniformTimeSeries(const double rate, const std::vector<double> &data, const double start=0.0) ;
+      //! Take ownership of `data` without copying.
+      UniformTimeSeries(const double rate, std::vector<double> &&data, const double start=0.0) ;
 
       virtual Point point(const size_t n) const ;
       virtual double time(const size_t n) const ;
-      virtual ssize_t index(const double t) ;
+      } ;
+
+
+    //! Points for several channels that share the same times, held either
+    //! interleaved (every channel at the first time, then at the second, ...)
+    //! or channel-major (all of the first channel, then all of the second, ...).
+    class BIOSIGNALML_EXPORT MultiTimeSeries
+    /*------------------------------------*/
+    {
+     public:
+      SHARED_PTR(MultiTimeSeries)
+      enum class Layout { INTERLEAVED, CHANNEL_MAJOR } ;
+
+      //! Take ownership of `times` and of `data`, which has `channels` values for each time.
+      MultiTimeSeries(std::vector<double> &&times, std::vector<double> &&data,
+                      const size_t channels, const Layout layout) ;
+      //! Points sampled at `rate`, starting at time `start`.
+      MultiTimeSeries(const double rate, const double start, std::vector<double> &&data,
+                      const size_t channels, const Layout layout) ;
+      virtual ~MultiTimeSeries() = default ;
+
+      inline size_t size(void) const { return m_size ; }
+      inline size_t channels(void) const { return m_channels ; }
+      inline Layout layout(void) const { return m_layout ; }
+      //! All values. A channel-major channel starts at `data()[channel*size()]`.
+      inline const std::vector<double> & data(void) const { return m_data ; }
+      inline double value(const size_t n, const size_t channel) const {
+        return (m_layout == Layout::INTERLEAVED) ? m_data[n*m_channels + channel]
+                                                 : m_data[channel*m_size + n] ;
+        }
+      double time(const size_t n) const ;
+      //! Copy the times of points `begin` up to `end` into `times`.
+      void times(const size_t begin, const size_t end, double *times) const ;
 
      private:
+      std::vector<double> m_times ;
+      std::vector<double> m_data ;
+      size_t m_channels ;
+      size_t m_size ;
+      Layout m_layout ;
       double m_rate ;
       double m_start ;
       } ;
@@ -70,6 +70,13 @@ namespace bsml {
     virtual bsml::data::TimeSeries::Ptr read(bsml::Interval::Ptr interval, ssize_t maxpoints=-1) ;
     //! Point based
     virtual data::TimeSeries::Ptr read(size_t pos=0, ssize_t length=0) ;
+    //! Time based, at a uniform `rate` lower than the signal's, with points
+    //! lowpass filtered so that frequencies above the new Nyquist don't alias.
+    virtual data::UniformTimeSeries::Ptr read_decimated(bsml::Interval::Ptr interval, double rate) ;
+    //! Time based, with points interpolated onto a uniform clock at `rate`
+    //! that starts with the first point in the interval.
+    virtual data::UniformTimeSeries::Ptr read_resampled(bsml::Interval::Ptr interval, double rate,
+      data::Interpolation method=data::Interpolation::LINEAR) ;
 
     } ;
 
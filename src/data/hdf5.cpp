@@ -20,12 +20,17 @@
 
 #include <biosignalml/data/hdf5.h>
 #include "hdf5impl.h"
+#include "transpose.h"
+#include "resample.h"
 
 #include <typedobject/units.h>
 
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <map>
+#include <chrono>
+#include <thread>
 
 using namespace bsml ;
 
@@ -58,6 +63,35 @@ size_t HDF5::Clock::index_right(const double t) const
   }
 
 
+std::pair<size_t, ssize_t> HDF5::Clock::index_range(const double start, const double end) const
+/*------------------------------------------------------------------------------------------*/
+{
+  if (rate() > 0.0) {
+    double first = std::ceil(start*rate()) ;
+    return std::make_pair((first > 0.0) ? (size_t)first : 0, (ssize_t)std::floor(end*rate())) ;
+    }
+  return m_data->index_range(start, end) ;
+  }
+
+void HDF5::Clock::set_cache_size(size_t bytes)
+/*------------------------------------------*/
+{
+  m_data->set_cache_size(bytes) ;
+  }
+
+void HDF5::Clock::set_index_size(size_t bytes)
+/*------------------------------------------*/
+{
+  m_data->set_index_size(bytes) ;
+  }
+
+void HDF5::Clock::rebuild_index(void)
+/*---------------------------------*/
+{
+  m_data->rebuild_index() ;
+  }
+
+
 void HDF5::Clock::extend(const double *times, const size_t length)
 /*--------------------------------------------------------------*/
 {
@@ -71,6 +105,12 @@ std::vector<double> HDF5::Clock::read(size_t pos, intmax_t length)
   return m_data->read(pos, length) ;
   }
 
+size_t HDF5::Clock::read(size_t pos, size_t length, double *times)
+/*--------------------------------------------------------------*/
+{
+  return m_data->read(pos, length, times) ;
+  }
+
 
 HDF5::Signal::Signal(const rdf::URI &uri, const rdf::URI &units, double rate)
 /*=========================================================================*/
@@ -94,30 +134,348 @@ void HDF5::Signal::extend(const double *points, const size_t length)
   m_data->extend(points, length, 1) ;
   }
 
-data::TimeSeries::Ptr HDF5::Signal::read(Interval::Ptr interval, ssize_t maxpoints)
-/*-------------------------------------------------------------------------------*/
+void HDF5::Signal::extend(const int16_t *points, const size_t length)
+/*-----------------------------------------------------------------*/
 {
-  double rt = this->rate() ;
+  m_data->extend(points, length, 1) ;
+  }
+
+void HDF5::Signal::extend(const int32_t *points, const size_t length)
+/*-----------------------------------------------------------------*/
+{
+  m_data->extend(points, length, 1) ;
+  }
+
+void HDF5::Signal::set_append_buffer(size_t size, HDF5::H5BufferUnits units)
+/*------------------------------------------------------------------------*/
+{
+  m_data->set_buffer_size(size, units) ;
+  }
+
+HDF5::StorageOptions HDF5::Signal::storage_options(void) const
+/*----------------------------------------------------------*/
+{
+  return m_data->storage_options() ;
+  }
+
+void HDF5::Signal::set_chunk_cache(const HDF5::ChunkCache &cache)
+/*-------------------------------------------------------------*/
+{
+  m_data->set_chunk_cache(cache) ;
+  }
+
+HDF5::CacheStatistics HDF5::Signal::cache_statistics(void) const
+/*------------------------------------------------------------*/
+{
+  return m_data->cache_statistics() ;
+  }
+
+// The position and number of a signal's points spanned by a closed interval.
+static std::pair<size_t, ssize_t> interval_points(HDF5::Signal &signal, Interval::Ptr interval)
+/*-------------------------------------------------------------------------------------------*/
+{
+  double rt = signal.rate() ;
+  double start = (double)interval->start() ;
+  double end = start + (double)interval->duration() ;
   ssize_t spos, epos ;
   if (rt > 0.0) {
-    spos = (size_t)std::ceil((double)interval->start()*rt) ;
-    epos = (size_t)std::floor((double)interval->start() + (double)interval->duration()) ;
+    spos = std::max((ssize_t)0, (ssize_t)std::ceil(start*rt)) ;
+    epos = (ssize_t)std::floor(end*rt) ;
     }
   else {
-    spos = clock()->index_right((double)interval->start()) ;
-    epos = clock()->index((double)interval->start() + (double)interval->duration()) ;
+    auto range = signal.clock()->index_range(start, end) ;
+    spos = range.first ;
+    epos = range.second ;
+    }
+  ssize_t len = std::max((ssize_t)0, epos - spos + 1) ;
+  return std::make_pair((size_t)spos, len) ;
+  }
+
+// The number of bins that give no more than `maxpoints` decimated points.
+static size_t envelope_bins(ssize_t maxpoints)
+/*------------------------------------------*/
+{
+  return (maxpoints < 2) ? maxpoints : maxpoints/2 ;
+  }
+
+// Decimate each bin to its minimum at its first point and its maximum at its
+// middle one (so times still ascend strictly), or to its mean when `maxpoints`
+// is 1, adding the positions of the points if `positions` is given.
+static void decimate_bins(const std::vector<HDF5::Bin> &bins, ssize_t maxpoints,
+/*----------------------------------------------------------------------------*/
+                          std::vector<double> &values, std::vector<size_t> *positions)
+{
+  for (auto const &bin : bins) {
+    if (positions != nullptr) positions->push_back(bin.start) ;
+    if (maxpoints == 1) {
+      values.push_back(bin.mean) ;
+      continue ;
+      }
+    values.push_back(bin.min) ;
+    if (bin.count > 1) {
+      if (positions != nullptr) positions->push_back(bin.start + bin.count/2) ;
+      values.push_back(bin.max) ;
+      }
+    }
+  }
+
+static std::vector<double> point_times(HDF5::Signal &signal, const std::vector<size_t> &positions)
+/*----------------------------------------------------------------------------------------------*/
+{
+  std::vector<double> times(positions.size()) ;
+  for (size_t n = 0 ;  n < positions.size() ;  ++n)
+    times[n] = (signal.rate() > 0.0) ? (double)positions[n]/signal.rate() : signal.clock()->time(positions[n]) ;
+  return times ;
+  }
+
+// The number of points from `range.first` that a dataset of `size` points has.
+static size_t available_points(const std::pair<size_t, ssize_t> &range, size_t size)
+/*--------------------------------------------------------------------------------*/
+{
+  return (range.first < size) ? std::min((size_t)range.second, size - range.first) : 0 ;
+  }
+
+data::TimeSeries::Ptr HDF5::Signal::read(Interval::Ptr interval, ssize_t maxpoints)
+/*-------------------------------------------------------------------------------*/
+{
+  auto range = interval_points(*this, interval) ;
+  if (maxpoints < 0 || range.second <= maxpoints) return read(range.first, range.second) ;
+  // Without a pyramid the envelope is found from every point
+  std::vector<HDF5::Bin> bins = m_data->envelope(range.first, range.second, envelope_bins(maxpoints)) ;
+  std::vector<double> points ;
+  std::vector<size_t> positions ;
+  decimate_bins(bins, maxpoints, points, &positions) ;
+  return std::make_shared<data::TimeSeries>(point_times(*this, positions), std::move(points)) ;
+  }
+
+data::MultiTimeSeries::Ptr HDF5::Signal::read_envelope(Interval::Ptr interval, size_t maxbins)
+/*------------------------------------------------------------------------------------------*/
+{
+  auto range = interval_points(*this, interval) ;
+  std::vector<HDF5::Bin> bins = m_data->envelope(range.first, range.second, maxbins) ;
+  std::vector<double> times, values ;
+  times.reserve(bins.size()) ;
+  values.reserve(3*bins.size()) ;
+  for (auto const &bin : bins) {
+    times.push_back((rate() > 0.0) ? (double)bin.start/rate() : clock()->time(bin.start)) ;
+    values.push_back(bin.min) ;
+    values.push_back(bin.max) ;
+    values.push_back(bin.mean) ;
+    }
+  return std::make_shared<data::MultiTimeSeries>(std::move(times), std::move(values), 3,
+                                                 data::MultiTimeSeries::Layout::INTERLEAVED) ;
+  }
+
+// Read `length` points from `pos`, which may be outside of the dataset, with
+// the dataset's first or last point standing in for those before or after it.
+static void read_padded(HDF5::Dataset &data, ssize_t pos, size_t length, double *buffer)
+/*------------------------------------------------------------------------------------*/
+{
+  size_t lead = (pos < 0) ? std::min((size_t)(-pos), length) : 0 ;
+  size_t count = data.read(pos + lead, length - lead, buffer + lead) ;
+  if ((lead + count) == 0) throw HDF5::Exception("Signal has no points to resample") ;
+  std::fill(buffer, buffer + lead, buffer[lead]) ;   // The first point
+  std::fill(buffer + lead + count, buffer + length, buffer[lead + count - 1]) ;
+  }
+
+data::UniformTimeSeries::Ptr HDF5::Signal::read_decimated(Interval::Ptr interval, double rate)
+/*------------------------------------------------------------------------------------------*/
+{
+  double rt = this->rate() ;
+  if (!(rt > 0.0)) throw HDF5::Exception("Only uniformly sampled signals can be decimated") ;
+  if (!(rate > 0.0) || rate > rt) throw HDF5::Exception("Decimated rate must be positive and not above the signal's") ;
+  auto range = interval_points(*this, interval) ;
+  const size_t length = available_points(range, m_data->size()) ;
+  std::vector<double> points ;
+  if (rate == rt || length == 0) {
+    points = m_data->read(range.first, length) ;
+    return std::make_shared<data::UniformTimeSeries>(rt, std::move(points), (double)range.first/rt) ;
+    }
+  const double ratio = rt/rate ;
+  data::Resampler resampler(ratio) ;
+  const ssize_t halfwidth = resampler.half_width() ;
+  const size_t count = (size_t)std::floor((double)(length - 1)/ratio) + 1 ;
+  const size_t rows = std::max((size_t)m_data->chunk_rows(), (size_t)BSML_H5_CHUNK_MIN_ROWS) ;
+  const size_t block = std::max((size_t)1, (size_t)(rows/ratio)) ;  // Points kept per block
+  points.resize(count) ;
+  std::vector<double> input ;
+  for (size_t n = 0 ;  n < count ;  n += block) {
+    size_t kept = std::min(block, count - n) ;
+    double position = range.first + n*ratio ;
+    ssize_t first = (ssize_t)std::floor(position) - halfwidth ;
+    ssize_t last = (ssize_t)std::floor(range.first + (n + kept - 1)*ratio) + halfwidth + 2 ;
+    input.resize(last - first + 1) ;
+    read_padded(*m_data, first, input.size(), input.data()) ;
+    resampler.resample(input.data(), position - first, kept, points.data() + n) ;
+    }
+  return std::make_shared<data::UniformTimeSeries>(rate, std::move(points), (double)range.first/rt) ;
+  }
+
+data::UniformTimeSeries::Ptr HDF5::Signal::read_resampled(Interval::Ptr interval, double rate,
+/*------------------------------------------------------------------------------------------*/
+                                                          data::Interpolation method)
+{
+  if (!(rate > 0.0)) throw HDF5::Exception("Resampled rate must be positive") ;
+  auto range = interval_points(*this, interval) ;
+  std::vector<double> points ;
+  if (range.second == 0) return std::make_shared<data::UniformTimeSeries>(rate, std::move(points)) ;
+  const size_t rows = std::max((size_t)m_data->chunk_rows(), (size_t)BSML_H5_CHUNK_MIN_ROWS) ;
+  std::vector<double> values(rows), times((this->rate() > 0.0) ? 0 : rows) ;
+  // Each block starts with the last point of the one before, so every
+  // resampled time falls between two points of a block.
+  size_t pos = range.first, end = range.first + range.second ;
+  double start = NAN ;
+  while (pos < end) {
+    auto block = read_view(pos, std::min(rows, end - pos), values.data(), times.data()) ;
+    size_t length = block.size() ;
+    if (length == 0) break ;
+    if (std::isnan(start)) start = block.time(0) ;
+    size_t n = points.size(), count = n ;
+    while (start + count/rate <= block.time(length - 1)) ++count ;
+    points.resize(count) ;
+    data::interpolate(block, start + n/rate, 1.0/rate, count - n, method, points.data() + n) ;
+    if (length == 1 || (pos + length) >= end) break ;
+    pos += length - 1 ;
     }
-  ssize_t len = epos - spos + 1 ;
-  return read(spos, maxpoints >= 0 ? std::min(len, maxpoints) : len) ;
+  return std::make_shared<data::UniformTimeSeries>(rate, std::move(points), std::isnan(start) ? 0.0 : start) ;
+  }
+
+data::Statistics HDF5::Signal::statistics(Interval::Ptr interval)
+/*-------------------------------------------------------------*/
+{
+  auto range = interval_points(*this, interval) ;
+  return statistics(range.first, available_points(range, m_data->size())) ;
+  }
+
+data::Statistics HDF5::Signal::statistics(size_t pos, ssize_t length)
+/*-----------------------------------------------------------------*/
+{
+  return m_data->statistics(pos, length) ;
+  }
+
+double HDF5::Signal::percentile(Interval::Ptr interval, double p)
+/*-------------------------------------------------------------*/
+{
+  auto range = interval_points(*this, interval) ;
+  size_t pos = range.first ;
+  auto reader = [this, pos](size_t offset, size_t length, double *buffer) -> size_t {
+    return m_data->read(pos + offset, length, buffer) ;
+    } ;
+  return data::percentile(reader, available_points(range, m_data->size()), p, BSML_H5_SELECT_VALUES) ;
   }
 
 data::TimeSeries::Ptr HDF5::Signal::read(size_t pos, ssize_t length)    // Point based
 /*----------------------------------------------------------------*/
 {
+  // The time series take ownership of the vectors we've read into
   if (rate() > 0)
-    return data::UniformTimeSeries::create(rate(), m_data->read(pos, length)) ;
-  else
-    return data::TimeSeries::create(clock()->m_data->read(pos, length), m_data->read(pos, length)) ;
+    return std::make_shared<data::UniformTimeSeries>(rate(), m_data->read(pos, length), (double)pos/rate()) ;
+  else {
+    auto points = m_data->read(pos, length) ;
+    return std::make_shared<data::TimeSeries>(clock()->m_data->read(pos, points.size()), std::move(points)) ;
+    }
+  }
+
+size_t HDF5::Signal::read(size_t pos, size_t length, double *points, double *times)
+/*-------------------------------------------------------------------------------*/
+{
+  size_t count = m_data->read(pos, length, points) ;
+  if (times != nullptr) {
+    double rt = this->rate() ;
+    if (rt > 0.0) {
+      for (size_t n = 0 ;  n < count ;  ++n) times[n] = (double)(pos + n)/rt ;
+      }
+    else clock()->m_data->read(pos, count, times) ;
+    }
+  return count ;
+  }
+
+data::TimeSeriesView HDF5::Signal::read_view(size_t pos, size_t length, double *points, double *times)
+/*-------------------------------------------------------------------------------------------------*/
+{
+  double rt = this->rate() ;
+  if (rt > 0.0) {
+    size_t count = m_data->read(pos, length, points) ;
+    return data::TimeSeriesView(points, count, rt, (double)pos/rt) ;
+    }
+  if (times == nullptr) throw HDF5::Exception("Times are needed to view points of a clocked signal") ;
+  size_t count = read(pos, length, points, times) ;
+  return data::TimeSeriesView(points, count, times) ;
+  }
+
+size_t HDF5::Signal::read(size_t pos, size_t length, int16_t *points)
+/*-----------------------------------------------------------------*/
+{
+  return m_data->read(pos, length, points) ;
+  }
+
+size_t HDF5::Signal::read(size_t pos, size_t length, int32_t *points)
+/*-----------------------------------------------------------------*/
+{
+  return m_data->read(pos, length, points) ;
+  }
+
+
+// Keep polling a cursor until it finds points or `timeout` seconds pass.
+template<typename C> static auto poll_until(C &cursor, double timeout) -> decltype(cursor.poll())
+/*---------------------------------------------------------------------------------------------*/
+{
+  typedef std::chrono::steady_clock clock ;
+  const clock::time_point deadline = clock::now()
+    + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(timeout)) ;
+  const clock::duration interval = std::chrono::milliseconds(BSML_H5_POLL_MILLISECONDS) ;
+  auto points = cursor.poll() ;
+  while (points->size() == 0) {
+    clock::time_point now = clock::now() ;
+    if (now >= deadline) break ;
+    std::this_thread::sleep_for(std::min(interval, deadline - now)) ;
+    points = cursor.poll() ;
+    }
+  return points ;
+  }
+
+HDF5::Signal::Cursor::Cursor(std::shared_ptr<HDF5::SignalData> data, std::shared_ptr<HDF5::ClockData> clock,
+/*========================================================================================================*/
+                             double rate, size_t pos)
+: m_data(data), m_clock(clock), m_rate(rate), m_position(pos)
+{
+  }
+
+// Points are only returned once their times have been written.
+data::TimeSeries::Ptr HDF5::Signal::Cursor::poll(void)
+/*--------------------------------------------------*/
+{
+  size_t pos = m_position ;
+  std::vector<double> points = m_data->read_tail(pos) ;
+  if (m_rate > 0.0) {
+    m_position += points.size() ;
+    return std::make_shared<data::UniformTimeSeries>(m_rate, std::move(points), (double)pos/m_rate) ;
+    }
+  std::vector<double> times(points.size()) ;
+  if (!points.empty()) {
+    times.resize(m_clock->read(pos, points.size(), times.data())) ;
+    points.resize(times.size()) ;
+    }
+  m_position += points.size() ;
+  return std::make_shared<data::TimeSeries>(std::move(times), std::move(points)) ;
+  }
+
+data::TimeSeries::Ptr HDF5::Signal::Cursor::poll(double timeout)
+/*------------------------------------------------------------*/
+{
+  return poll_until(*this, timeout) ;
+  }
+
+size_t HDF5::Signal::Cursor::position(void) const
+/*---------------------------------------------*/
+{
+  return m_position ;
+  }
+
+HDF5::Signal::Cursor HDF5::Signal::cursor(size_t pos)
+/*-------------------------------------------------*/
+{
+  return Cursor(m_data, (rate() > 0.0) ? nullptr : clock()->m_data, rate(), pos) ;
   }
 
 
@@ -127,35 +485,182 @@ void HDF5::SignalArray::extend(const double *points, const size_t length)
   m_data->extend(points, length, this->size()) ;
   }
 
+void HDF5::SignalArray::extend(const int16_t *points, const size_t length)
+/*-----------------------------------------------------------------------*/
+{
+  m_data->extend(points, length, this->size()) ;
+  }
 
-int HDF5::SignalArray::index(const std::string &uri) const
-/*------------------------------------------------------*/
+void HDF5::SignalArray::extend(const int32_t *points, const size_t length)
+/*-----------------------------------------------------------------------*/
 {
-  return -1 ;
+  m_data->extend(points, length, this->size()) ;
   }
 
+void HDF5::SignalArray::extend(const double *const *points, const size_t length)
+/*----------------------------------------------------------------------------*/
+{
+  m_data->extend(points, length) ;
+  }
 
-HDF5::Recording::Recording(const rdf::URI &uri, const std::string &filename, bool create)
+void HDF5::SignalArray::set_append_buffer(size_t size, HDF5::H5BufferUnits units)
+/*-----------------------------------------------------------------------------*/
+{
+  m_data->set_buffer_size(size, units) ;
+  }
+
+data::MultiTimeSeries::Ptr HDF5::SignalArray::read(size_t pos, ssize_t length,
+/*---------------------------------------------------------------------------*/
+                                                   data::MultiTimeSeries::Layout layout)
+{
+  if (this->empty()) throw HDF5::Exception("Signal array has no signals") ;
+  size_t channels = this->size() ;
+  std::vector<double> block = m_data->read(pos, length) ;   // Rows of interleaved points
+  size_t rows = block.size()/channels ;
+  if (layout == data::MultiTimeSeries::Layout::CHANNEL_MAJOR) {
+    std::vector<double> planar(block.size()) ;
+    std::vector<double *> planes(channels) ;
+    for (size_t c = 0 ;  c < channels ;  ++c) planes[c] = planar.data() + c*rows ;
+    data::deinterleave(block.data(), rows, channels, planes.data()) ;
+    block.swap(planar) ;
+    }
+  // The time series takes ownership of the vectors we've read into
+  HDF5::Signal::Ptr first = this->front() ;
+  if (first->rate() > 0.0)
+    return std::make_shared<data::MultiTimeSeries>(first->rate(), (double)pos/first->rate(),
+                                                   std::move(block), channels, layout) ;
+  else
+    return std::make_shared<data::MultiTimeSeries>(first->clock()->read(pos, rows),
+                                                   std::move(block), channels, layout) ;
+  }
+
+size_t HDF5::SignalArray::read(size_t pos, size_t length, double *const *points)
+/*---------------------------------------------------------------------------*/
+{
+  return m_data->read(pos, length, points) ;
+  }
+
+data::MultiTimeSeries::Ptr HDF5::SignalArray::read(Interval::Ptr interval, ssize_t maxpoints,
+/*-----------------------------------------------------------------------------------------*/
+                                                   data::MultiTimeSeries::Layout layout)
+{
+  if (this->empty()) throw HDF5::Exception("Signal array has no signals") ;
+  auto range = interval_points(*this->front(), interval) ;
+  if (maxpoints < 0 || range.second <= maxpoints) return read(range.first, range.second, layout) ;
+  // Decimated as a signal's points are, with every channel's bins found in one pass
+  const size_t channels = this->size() ;
+  std::vector<hsize_t> columns(channels) ;
+  for (size_t c = 0 ;  c < channels ;  ++c) columns[c] = c ;
+  auto bins = m_data->envelope(columns, range.first, range.second, envelope_bins(maxpoints)) ;
+  std::vector<size_t> positions ;
+  std::vector<double> planar ;
+  for (size_t c = 0 ;  c < channels ;  ++c) decimate_bins(bins[c], maxpoints, planar, (c == 0) ? &positions : nullptr) ;
+  const size_t rows = positions.size() ;
+  if (layout == data::MultiTimeSeries::Layout::INTERLEAVED) {
+    std::vector<double> block(planar.size()) ;
+    std::vector<const double *> planes(channels) ;
+    for (size_t c = 0 ;  c < channels ;  ++c) planes[c] = planar.data() + c*rows ;
+    data::interleave(planes.data(), channels, rows, block.data()) ;
+    planar.swap(block) ;
+    }
+  return std::make_shared<data::MultiTimeSeries>(point_times(*this->front(), positions),
+                                                 std::move(planar), channels, layout) ;
+  }
+
+HDF5::StorageOptions HDF5::SignalArray::storage_options(void) const
+/*---------------------------------------------------------------*/
+{
+  return m_data->storage_options() ;
+  }
+
+void HDF5::SignalArray::set_chunk_cache(const HDF5::ChunkCache &cache)
+/*------------------------------------------------------------------*/
+{
+  m_data->set_chunk_cache(cache) ;
+  }
+
+HDF5::CacheStatistics HDF5::SignalArray::cache_statistics(void) const
+/*-----------------------------------------------------------------*/
+{
+  return m_data->cache_statistics() ;
+  }
+
+HDF5::SignalArray::Cursor::Cursor(std::shared_ptr<HDF5::SignalData> data,
+/*=====================================================================*/
+                                  std::shared_ptr<HDF5::ClockData> clock,
+                                  double rate, size_t channels, size_t pos)
+: m_data(data), m_clock(clock), m_rate(rate), m_channels(channels), m_position(pos)
+{
+  }
+
+data::MultiTimeSeries::Ptr HDF5::SignalArray::Cursor::poll(void)
+/*------------------------------------------------------------*/
+{
+  size_t pos = m_position ;
+  std::vector<double> block = m_data->read_tail(pos) ;   // Rows of interleaved points
+  size_t rows = block.size()/m_channels ;
+  if (m_rate > 0.0) {
+    m_position += rows ;
+    return std::make_shared<data::MultiTimeSeries>(m_rate, (double)pos/m_rate,
+                                                   std::move(block), m_channels,
+                                                   data::MultiTimeSeries::Layout::INTERLEAVED) ;
+    }
+  std::vector<double> times(rows) ;
+  if (rows > 0) {
+    rows = m_clock->read(pos, rows, times.data()) ;
+    times.resize(rows) ;
+    block.resize(rows*m_channels) ;
+    }
+  m_position += rows ;
+  return std::make_shared<data::MultiTimeSeries>(std::move(times), std::move(block), m_channels,
+                                                   data::MultiTimeSeries::Layout::INTERLEAVED) ;
+  }
+
+data::MultiTimeSeries::Ptr HDF5::SignalArray::Cursor::poll(double timeout)
+/*----------------------------------------------------------------------*/
+{
+  return poll_until(*this, timeout) ;
+  }
+
+size_t HDF5::SignalArray::Cursor::position(void) const
+/*--------------------------------------------------*/
+{
+  return m_position ;
+  }
+
+HDF5::SignalArray::Cursor HDF5::SignalArray::cursor(size_t pos)
+/*-----------------------------------------------------------*/
+{
+  if (this->empty()) throw HDF5::Exception("Signal array has no signals") ;
+  HDF5::Signal::Ptr first = this->front() ;
+  return Cursor(m_data, (first->rate() > 0.0) ? nullptr : first->clock()->m_data,
+                first->rate(), this->size(), pos) ;
+  }
+
+
+HDF5::Recording::Recording(const rdf::URI &uri, const std::string &filename, bool create,
 /*-------------------------------------------------------------------------------------*/
+                           const HDF5::ChunkCache &cache, bool swmr)
 : HDF5::Recording(uri)
 {
   m_readonly = false ;
   if (create) {
-    m_file = HDF5::File::create(uri.to_string(), filename, true) ;
+    m_file = HDF5::File::create(uri.to_string(), filename, true, cache, swmr) ;
     }
   else {
-    m_file = HDF5::File::open(filename) ;
+    m_file = HDF5::File::open(filename, false, cache, swmr) ;
     // Need to read metadata and create objects...
     // And ensure URI is as expected.... (as below...)
     }
   }
 
 
-HDF5::Recording::Recording(const std::string &filename, bool readonly)
-/*------------------------------------------------------------------*/
+HDF5::Recording::Recording(const std::string &filename, bool readonly, const HDF5::ChunkCache &cache,
+/*----------------------------------------------------------------------------------------------*/
+                           bool swmr)
 : HDF5::Recording(rdf::URI())
 {
-  m_file = HDF5::File::open(filename, readonly) ;
+  m_file = HDF5::File::open(filename, readonly, cache, swmr) ;
   m_readonly = readonly ;
 
   this->set_uri(rdf::URI(m_file->get_uri())) ;
@@ -179,8 +684,171 @@ HDF5::Recording::Recording(const std::string &filename, bool readonly)
     if (s->rate() <= 0) {
       if (clk && clk->is_valid()) clk->m_data = m_file->get_clock(clk->uri().to_string()) ;
       else throw HDF5::Exception("Signal with no rate doesn't have a clock") ;
+      s->m_data->set_clock(clk->m_data) ;
+      datasets.insert(clk->m_data) ;
       }
     }
+  if (readonly && swmr) {
+    for (auto ds : datasets) ds->set_live(true) ;
+    }
+  }
+
+
+void HDF5::Recording::add_dataset(std::shared_ptr<HDF5::Dataset> dataset)
+/*---------------------------------------------------------------------*/
+{
+  if (m_buffer_size > 0) dataset->set_buffer_size(m_buffer_size, m_buffer_units) ;
+  if (m_writer != nullptr) dataset->set_writer(m_writer) ;
+  if (m_error_handler) dataset->set_error_handler(m_error_handler) ;
+  datasets.insert(dataset) ;
+  }
+
+void HDF5::Recording::set_async_writes(size_t length)
+/*-------------------------------------------------*/
+{
+  stop_writer() ;
+  if (length > 0) {
+    m_writer = std::make_shared<HDF5::AsyncWriter>(length) ;
+    for (auto ds : datasets) ds->set_writer(m_writer) ;
+    }
+  }
+
+void HDF5::Recording::sync(void)
+/*----------------------------*/
+{
+  if (m_writer != nullptr) m_writer->sync() ;
+  }
+
+void HDF5::Recording::set_error_handler(HDF5::ErrorHandler handler)
+/*---------------------------------------------------------------*/
+{
+  m_error_handler = handler ;
+  for (auto ds : datasets) ds->set_error_handler(m_error_handler) ;
+  }
+
+void HDF5::Recording::set_deferred_durability(bool defer)
+/*-----------------------------------------------------*/
+{
+  m_deferred = defer ;
+  defer_flushes() ;
+  }
+
+void HDF5::Recording::begin_definitions(void)
+/*-----------------------------------------*/
+{
+  ++m_definitions ;
+  defer_flushes() ;
+  }
+
+void HDF5::Recording::end_definitions(void)
+/*---------------------------------------*/
+{
+  if (m_definitions == 0) throw HDF5::Exception("end_definitions() without begin_definitions()") ;
+  if (--m_definitions == 0) {
+    defer_flushes() ;
+    if (!m_deferred && m_file != nullptr) {
+      sync() ;
+      m_file->flush() ;
+      }
+    }
+  }
+
+// Datasets can't be created, nor metadata rewritten, once SWMR writing
+// has started, so the recording's metadata is stored now.
+void HDF5::Recording::start_swmr_write(void)
+/*----------------------------------------*/
+{
+  if (m_file == nullptr || m_readonly) throw HDF5::Exception("Recording isn't open for writing") ;
+  if (m_swmr) return ;
+  flush() ;
+  for (auto ds : datasets) {
+    auto clock = std::dynamic_pointer_cast<HDF5::ClockData>(ds) ;
+    if (clock != nullptr) clock->create_index() ;
+    }
+  rdf::Graph::Format format = rdf::Graph::Format::TURTLE ;
+  m_file->store_metadata(serialise_metadata(format, m_base, true),
+                         rdf::Graph::format_to_mimetype(format)) ;
+  m_file->flush() ;
+  m_file->start_swmr_write() ;
+  m_swmr = true ;
+  }
+
+void HDF5::Recording::refresh(void)
+/*-------------------------------*/
+{
+  sync() ;
+  for (auto ds : datasets) ds->refresh() ;
+  }
+
+void HDF5::Recording::check_definable(void)
+/*---------------------------------------*/
+{
+  if (m_swmr) throw HDF5::Exception("Cannot define signals or clocks once SWMR writing has started") ;
+  }
+
+void HDF5::Recording::defer_flushes(void)
+/*-------------------------------------*/
+{
+  if (m_file != nullptr) m_file->set_deferred_flush(m_deferred || m_definitions > 0) ;
+  }
+
+// Appends are written by the caller once the writer has finished, with
+// any write error thrown after the writer has stopped.
+void HDF5::Recording::stop_writer(void)
+/*-----------------------------------*/
+{
+  if (m_writer == nullptr) return ;
+  std::string error ;
+  try {
+    m_writer->sync() ;
+    }
+  catch (const HDF5::Exception &e) {
+    error = e.what() ;
+    }
+  for (auto ds : datasets) ds->set_writer(nullptr) ;
+  m_writer->stop() ;
+  m_writer = nullptr ;
+  if (!error.empty()) throw HDF5::Exception(error) ;
+  }
+
+void HDF5::Recording::set_append_buffer(size_t size, HDF5::H5BufferUnits units)
+/*---------------------------------------------------------------------------*/
+{
+  m_buffer_size = size ;
+  m_buffer_units = units ;
+  for (auto ds : datasets) ds->set_buffer_size(size, units) ;
+  }
+
+void HDF5::Recording::set_storage_options(const HDF5::StorageOptions &options)
+/*-------------------------------------------------------------------------*/
+{
+  m_storage = options ;
+  }
+
+HDF5::CacheStatistics HDF5::Recording::cache_statistics(void) const
+/*---------------------------------------------------------------*/
+{
+  HDF5::CacheStatistics statistics ;
+  for (auto ds : datasets) {
+    HDF5::CacheStatistics s = ds->cache_statistics() ;
+    statistics.hits += s.hits ;
+    statistics.misses += s.misses ;
+    }
+  return statistics ;
+  }
+
+// With deferred durability, or when SWMR readers are waiting for
+// the points, the file itself is also flushed.
+void HDF5::Recording::flush(void)
+/*-----------------------------*/
+{
+  sync() ;
+  for (auto ds : datasets) {
+    ds->flush() ;
+    auto clock = std::dynamic_pointer_cast<HDF5::ClockData>(ds) ;
+    if (clock != nullptr) clock->save_index() ;
+    }
+  if ((m_deferred || m_swmr) && m_file != nullptr) m_file->flush() ;
   }
 
 
@@ -188,7 +856,30 @@ void HDF5::Recording::close(void)
 /*-----------------------------*/
 {
   if (m_file != nullptr) {
-    if (!m_readonly) {
+    std::string error ;
+    try {
+      stop_writer() ;
+      }
+    catch (const HDF5::Exception &e) {
+      error = e.what() ;
+      }
+    try {
+      flush() ;
+      }
+    catch (const std::exception &e) {
+      if (error.empty()) throw ;
+      throw HDF5::Exception(error + " (and then flushing failed: " + e.what() + ")") ;
+      }
+    if (!m_readonly && !m_swmr) {
+      for (auto const & u : get_signal_uris()) {   // Chunk summaries give the extremes cheaply
+        auto sig = get_signal(u) ;
+        if (sig->m_data == nullptr || !sig->m_data->has_summary()) continue ;
+        data::Statistics stats = sig->m_data->statistics(0, -1) ;
+        if (stats.count() > 0) {
+          sig->set_minValue(stats.min()) ;
+          sig->set_maxValue(stats.max()) ;
+          }
+        }
       rdf::Graph::Format format = rdf::Graph::Format::TURTLE ;
 // Prefixes are duplicated in file...  (serd bug ??)
       m_file->store_metadata(serialise_metadata(format, m_base, true),
@@ -198,6 +889,7 @@ void HDF5::Recording::close(void)
     m_file->close() ;
     delete m_file ;
     m_file = nullptr ;
+    if (!error.empty()) throw HDF5::Exception(error) ;
     }
   }
 
@@ -244,11 +936,97 @@ HDF5::Signal::Ptr HDF5::Recording::get_signal(const std::string &uri)
   }
 
 
+std::vector<data::TimeSeries::Ptr> HDF5::Recording::read_signals(const std::vector<std::string> &uris,
+/*--------------------------------------------------------------------------------------------------*/
+                                                                 size_t pos, ssize_t length)
+{
+  return read_signals(uris, nullptr, pos, length) ;
+  }
+
+std::vector<data::TimeSeries::Ptr> HDF5::Recording::read_signals(const std::vector<std::string> &uris,
+/*--------------------------------------------------------------------------------------------------*/
+                                                                 Interval::Ptr interval, ssize_t maxpoints)
+{
+  return read_signals(uris, interval, 0, maxpoints) ;
+  }
+
+// Read from `pos` or, if given, over `interval` with at most `length` points.
+std::vector<data::TimeSeries::Ptr> HDF5::Recording::read_signals(const std::vector<std::string> &uris,
+/*--------------------------------------------------------------------------------------------------*/
+                                                                 Interval::Ptr interval,
+                                                                 size_t pos, ssize_t length)
+{
+  std::vector<HDF5::Signal::Ptr> signals ;
+  std::map<hobj_ref_t, std::vector<size_t>> groups ;   // Positions in `uris`, by dataset
+  for (auto const &uri : uris) {
+    HDF5::Signal::Ptr signal = get_signal(uri) ;
+    if (signal->m_data == nullptr) throw HDF5::Exception("Signal '" + uri + "' has no data") ;
+    groups[signal->m_data->get_reference()].push_back(signals.size()) ;
+    signals.push_back(signal) ;
+    }
+
+  std::vector<data::TimeSeries::Ptr> result(signals.size()) ;
+  for (auto const &group : groups) {
+    HDF5::Signal::Ptr first = signals[group.second[0]] ;
+    size_t start = pos ;
+    ssize_t count = length ;
+    ssize_t maxpoints = -1 ;      // Decimate an interval with more points
+    if (interval) {
+      auto range = interval_points(*first, interval) ;
+      start = range.first ;
+      count = range.second ;
+      if (length >= 0 && count > length) maxpoints = length ;
+      }
+    if (group.second.size() == 1 || first->m_data->column() < 0) {
+      for (auto n : group.second)
+        result[n] = (maxpoints >= 0) ? signals[n]->read(interval, maxpoints) : signals[n]->read(start, count) ;
+      continue ;
+      }
+    std::vector<hsize_t> columns ;
+    for (auto n : group.second) columns.push_back(signals[n]->m_data->column()) ;
+    std::sort(columns.begin(), columns.end()) ;
+    columns.erase(std::unique(columns.begin(), columns.end()), columns.end()) ;
+    if (maxpoints >= 0) {         // Every column's bins found in one pass
+      auto bins = first->m_data->envelope(columns, start, count, envelope_bins(maxpoints)) ;
+      std::vector<size_t> positions ;
+      std::vector<double> first_values ;
+      decimate_bins(bins[0], maxpoints, first_values, &positions) ;
+      std::vector<double> times = point_times(*first, positions) ;
+      for (auto n : group.second) {
+        size_t c = std::lower_bound(columns.begin(), columns.end(),
+                                    (hsize_t)signals[n]->m_data->column()) - columns.begin() ;
+        std::vector<double> points ;
+        decimate_bins(bins[c], maxpoints, points, nullptr) ;
+        result[n] = std::make_shared<data::TimeSeries>(std::vector<double>(times), std::move(points)) ;
+        }
+      continue ;
+      }
+    std::vector<double> block = first->m_data->read_columns(columns, start, count) ;
+    size_t rows = block.size()/columns.size() ;
+    std::vector<double> times ;
+    if (first->rate() <= 0.0) times = first->clock()->read(start, rows) ;
+    for (auto n : group.second) {
+      size_t c = std::lower_bound(columns.begin(), columns.end(),
+                                  (hsize_t)signals[n]->m_data->column()) - columns.begin() ;
+      std::vector<double> points(rows) ;
+      for (size_t r = 0 ;  r < rows ;  ++r) points[r] = block[r*columns.size() + c] ;
+      if (first->rate() > 0.0)
+        result[n] = std::make_shared<data::UniformTimeSeries>(first->rate(), std::move(points),
+                                                              (double)start/first->rate()) ;
+      else
+        result[n] = std::make_shared<data::TimeSeries>(std::vector<double>(times), std::move(points)) ;
+      }
+    }
+  return result ;
+  }
+
+
 HDF5::Clock::Ptr HDF5::Recording::new_clock(const std::string &uri,
 /*---------------------------------------------------------------*/
                                             const rdf::URI &units,
                                             double *data, size_t datasize)
 {
+  check_definable() ;
   auto clock = bsml::Recording::new_clock<HDF5::Clock>(uri, units) ;
   try {
     std::string u = units.to_string() ;
@@ -258,8 +1036,10 @@ HDF5::Clock::Ptr HDF5::Recording::new_clock(const std::string &uri,
     }
   catch (const std::exception &error) {
     }
-  clock->m_data = m_file->create_clock(clock->uri().to_string(), units.to_string(), data, datasize) ;
-  datasets.insert(clock->m_data) ;
+  sync() ;    // The file is only used by one thread at a time
+  clock->m_data = m_file->create_clock(clock->uri().to_string(), units.to_string(),
+                                       data, datasize, m_storage) ;
+  add_dataset(clock->m_data) ;
   return clock ;
   }
 
@@ -269,24 +1049,46 @@ HDF5::Signal::Ptr HDF5::Recording::new_signal(const std::string &uri,
                                               const rdf::URI &units,
                                               double rate)
 {
+  return new_signal(uri, units, rate, m_storage) ;
+  }
+
+HDF5::Signal::Ptr HDF5::Recording::new_signal(const std::string &uri,
+/*-----------------------------------------------------------------*/
+                                              const rdf::URI &units,
+                                              HDF5::Clock::Ptr clock)
+{
+  return new_signal(uri, units, clock, m_storage) ;
+  }
+
+HDF5::Signal::Ptr HDF5::Recording::new_signal(const std::string &uri,
+/*-----------------------------------------------------------------*/
+                                              const rdf::URI &units,
+                                              double rate,
+                                              const HDF5::StorageOptions &options)
+{
+  check_definable() ;
   auto signal = bsml::Recording::new_signal<HDF5::Signal>(uri, units, rate) ;
+  sync() ;
   signal->m_data = m_file->create_signal(signal->uri().to_string(), units.to_string(),
                                          nullptr, 0, std::vector<hsize_t>(),
-                                         1.0, 0.0, rate, nullptr) ;
-  datasets.insert(signal->m_data) ;
+                                         options.gain, options.offset, rate, nullptr, options) ;
+  add_dataset(signal->m_data) ;
   return signal ;
   }
 
 HDF5::Signal::Ptr HDF5::Recording::new_signal(const std::string &uri,
 /*-----------------------------------------------------------------*/
                                               const rdf::URI &units,
-                                              HDF5::Clock::Ptr clock)
+                                              HDF5::Clock::Ptr clock,
+                                              const HDF5::StorageOptions &options)
 {
+  check_definable() ;
   auto signal = bsml::Recording::new_signal<HDF5::Signal, HDF5::Clock>(uri, units, clock) ;
+  sync() ;
   signal->m_data = m_file->create_signal(signal->uri().to_string(), units.to_string(),
                                          nullptr, 0, std::vector<hsize_t>(),
-                                         1.0, 0.0, 0.0, clock->m_data) ;
-  datasets.insert(signal->m_data) ;
+                                         options.gain, options.offset, 0.0, clock->m_data, options) ;
+  add_dataset(signal->m_data) ;
   return signal ;
   }
 
@@ -296,29 +1098,61 @@ HDF5::SignalArray::Ptr HDF5::Recording::new_signalarray(const std::vector<std::s
                                                         const std::vector<rdf::URI> &units,
                                                         double rate)
 {
+  return new_signalarray(uris, units, rate, m_storage) ;
+  }
+
+HDF5::SignalArray::Ptr HDF5::Recording::new_signalarray(const std::vector<std::string> &uris,
+/*-----------------------------------------------------------------------------------------*/
+                                                        const std::vector<rdf::URI> &units,
+                                                        HDF5::Clock::Ptr clock)
+{
+  return new_signalarray(uris, units, clock, m_storage) ;
+  }
+
+HDF5::SignalArray::Ptr HDF5::Recording::new_signalarray(const std::vector<std::string> &uris,
+/*-----------------------------------------------------------------------------------------*/
+                                                        const std::vector<rdf::URI> &units,
+                                                        double rate,
+                                                        const HDF5::StorageOptions &options)
+{
+  check_definable() ;
   auto signals =
     data::Recording::create_signalarray<HDF5::SignalArray, HDF5::Signal, HDF5::Clock>(uris, units, rate, nullptr) ;
   std::vector<std::string> uri_strings ;
   for (auto &s : *signals) uri_strings.push_back(s->uri().to_string()) ;
   std::vector<std::string> unit_strings ;
   for (auto const &unit : units) unit_strings.push_back(unit.to_string()) ;
-  signals->m_data = m_file->create_signal(uri_strings, unit_strings, nullptr, 0, 1.0, 0.0, rate, nullptr) ;
-  datasets.insert(signals->m_data) ;
+  sync() ;
+  signals->m_data = m_file->create_signal(uri_strings, unit_strings, nullptr, 0,
+                                          options.gain, options.offset, rate, nullptr, options) ;
+  add_dataset(signals->m_data) ;
+  for (auto &s : *signals) {
+    s->m_data = m_file->get_signal(s->uri().to_string()) ;
+    s->m_data->set_parent(signals->m_data) ;
+    }
   return signals ;
   }
 
 HDF5::SignalArray::Ptr HDF5::Recording::new_signalarray(const std::vector<std::string> &uris,
 /*-----------------------------------------------------------------------------------------*/
                                                         const std::vector<rdf::URI> &units,
-                                                        HDF5::Clock::Ptr clock)
+                                                        HDF5::Clock::Ptr clock,
+                                                        const HDF5::StorageOptions &options)
 {
+  check_definable() ;
   auto signals =
     data::Recording::create_signalarray<HDF5::SignalArray, HDF5::Signal, HDF5::Clock>(uris, units, 0.0, clock) ;
   std::vector<std::string> uri_strings ;
   for (auto &s : *signals) uri_strings.push_back(s->uri().to_string()) ;
   std::vector<std::string> unit_strings ;
   for (auto const &unit : units) unit_strings.push_back(unit.to_string()) ;
-  signals->m_data = m_file->create_signal(uri_strings, unit_strings, nullptr, 0, 1.0, 0.0, 0.0, clock->m_data) ;
-  datasets.insert(signals->m_data) ;
+  sync() ;
+  signals->m_data = m_file->create_signal(uri_strings, unit_strings, nullptr, 0,
+                                          options.gain, options.offset, 0.0, clock->m_data, options) ;
+  add_dataset(signals->m_data) ;
+  for (auto &s : *signals) {
+    s->m_data = m_file->get_signal(s->uri().to_string()) ;
+    s->m_data->set_parent(signals->m_data) ;
+    }
   return signals ;
   }
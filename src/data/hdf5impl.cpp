@@ -26,9 +26,11 @@
 #include <list>
 #include <string.h>    // For memcpy() and strcmp()
 #include <algorithm>
+#include <cmath>
 
 #include <biosignalml/data/hdf5.h>
 #include "hdf5impl.h"
+#include "transpose.h"
 
 
 /** New (HDF5 1.10 SWMR feature allows single writer, multiple readers... **/
@@ -62,7 +64,23 @@ HDF5::Dataset::Dataset()
 : m_uri(""),
   m_dataset(H5::DataSet()),
   m_reference(0),
-  m_index(-1)
+  m_index(-1),
+  m_rank(0),
+  m_chunkrows(0),
+  m_live(false),
+  m_parent(nullptr),
+  m_writer(nullptr),
+  m_summaries_opened(false),
+  m_clock(nullptr),
+  m_clocksize(-1),
+  m_buffer_rows(0),
+  m_rowsize(1),
+  m_chunkcols(0),
+  m_gain(1.0),
+  m_offset(0.0),
+  m_integer(false),
+  m_minstored(0.0),
+  m_maxstored(0.0)
 {
   }
 
@@ -73,7 +91,23 @@ HDF5::Dataset::Dataset(const std::string &uri, const HDF5::DatasetRef &dataref)
 /*---------------------------------------------------------------------------*/
 : m_uri(uri),
   m_dataset(dataref.first),
-  m_reference(dataref.second)
+  m_reference(dataref.second),
+  m_rank(0),
+  m_chunkrows(0),
+  m_live(false),
+  m_parent(nullptr),
+  m_writer(nullptr),
+  m_summaries_opened(false),
+  m_clock(nullptr),
+  m_clocksize(-1),
+  m_buffer_rows(0),
+  m_rowsize(1),
+  m_chunkcols(0),
+  m_gain(1.0),
+  m_offset(0.0),
+  m_integer(false),
+  m_minstored(0.0),
+  m_maxstored(0.0)
 {
   int index = -1 ;
   H5::StrType varstr(H5::PredType::C_S1, H5T_VARIABLE) ;
@@ -112,18 +146,119 @@ HDF5::Dataset::Dataset(const std::string &uri, const HDF5::DatasetRef &dataref)
       }
     }
   m_index = index ;
+
+  // Resolve any clock reference once, rather than on every extend.
+  try {
+    H5::Attribute attr = m_dataset.openAttribute("clock") ;
+    hobj_ref_t ref ;
+    attr.read(H5::PredType::STD_REF_OBJ, &ref) ;
+    attr.close() ;
+    m_clockset = H5::DataSet(m_dataset, &ref) ;
+    }
+  catch (const H5::AttributeIException &e) { }
+  refresh() ;
+
+  try {
+    H5::Attribute attr = m_dataset.openAttribute("gain") ;
+    attr.read(H5::PredType::NATIVE_DOUBLE, &m_gain) ;
+    }
+  catch (const H5::AttributeIException &e) { }
+  try {
+    H5::Attribute attr = m_dataset.openAttribute("offset") ;
+    attr.read(H5::PredType::NATIVE_DOUBLE, &m_offset) ;
+    }
+  catch (const H5::AttributeIException &e) { }
+  if (m_dataset.getTypeClass() == H5T_INTEGER) {
+    H5::IntType itype = m_dataset.getIntType() ;
+    int bits = 8*itype.getSize() ;
+    m_integer = true ;
+    if (itype.getSign() == H5T_SGN_NONE) {
+      m_minstored = 0.0 ;
+      m_maxstored = std::ldexp(1.0, bits) - 1.0 ;
+      }
+    else {
+      m_minstored = -std::ldexp(1.0, bits - 1) ;
+      m_maxstored = std::ldexp(1.0, bits - 1) - 1.0 ;
+      }
+    }
+
+  H5::DSetCreatPropList props = m_dataset.getCreatePlist() ;
+  if (props.getLayout() == H5D_CHUNKED) {
+    hsize_t chunks[H5S_MAX_RANK] ;
+    props.getChunk(m_rank, chunks) ;
+    m_chunkrows = chunks[0] ;
+    m_chunkcols = (m_rank > 1) ? chunks[1] : 1 ;
+    set_cache_capacity() ;
+    }
+
+  if (m_index < 0) open_summaries() ;   // Array members usually share their parent's
+  }
+
+// Open the pyramid and chunk summary the dataset refers to. They are
+// opened on first use for array members, which read through their
+// parent's and would otherwise each hold copies.
+void HDF5::Dataset::open_summaries(void) const
+/*------------------------------------------*/
+{
+  HDF5::Dataset *self = const_cast<HDF5::Dataset *>(this) ;
+  m_summaries_opened = true ;
+  try {
+    H5::Attribute attr = m_dataset.openAttribute("pyramid") ;
+    hobj_ref_t ref ;
+    attr.read(H5::PredType::STD_REF_OBJ, &ref) ;
+    attr.close() ;
+    m_pyramid = std::make_shared<HDF5::Pyramid>(self, H5::Group(m_dataset, &ref)) ;
+    if (m_live) m_pyramid->set_live(true) ;
+    }
+  catch (const H5::AttributeIException &e) { }
+  try {
+    H5::Attribute attr = m_dataset.openAttribute("summary") ;
+    hobj_ref_t ref ;
+    attr.read(H5::PredType::STD_REF_OBJ, &ref) ;
+    attr.close() ;
+    m_summary = std::make_shared<HDF5::ChunkSummary>(self, H5::DataSet(m_dataset, &ref)) ;
+    if (m_live) m_summary->set_live(true) ;
+    }
+  catch (const H5::AttributeIException &e) { }
+  }
+
+std::shared_ptr<HDF5::Pyramid> HDF5::Dataset::pyramid(void) const
+/*-------------------------------------------------------------*/
+{
+  if (m_parent != nullptr) return m_parent->pyramid() ;
+  if (!m_summaries_opened) open_summaries() ;
+  return m_pyramid ;
+  }
+
+std::shared_ptr<HDF5::ChunkSummary> HDF5::Dataset::summary(void) const
+/*------------------------------------------------------------------*/
+{
+  if (m_parent != nullptr) return m_parent->summary() ;
+  if (!m_summaries_opened) open_summaries() ;
+  return m_summary ;
   }
 
 HDF5::Dataset::~Dataset()
 /*---------------------*/
 {
-  close() ;
+  try {
+    close() ;
+    }
+  catch (const std::exception &e) {   // Destructors mustn't throw
+    if (m_error_handler) m_error_handler("Error closing dataset '" + m_uri + "': " + e.what()) ;
+    }
+  catch (...) {
+    if (m_error_handler) m_error_handler("Error closing dataset '" + m_uri + "'") ;
+    }
   }
 
 
 void HDF5::Dataset::close(void)
 /*---------------------------*/
 {
+  if (m_dataset.getId() >= 0) flush() ;
+  if (m_pyramid != nullptr) m_pyramid->close() ;
+  if (m_summary != nullptr) m_summary->close() ;
   if (m_index == -1) m_dataset.close() ;
   }
 
@@ -140,19 +275,266 @@ hobj_ref_t HDF5::Dataset::get_reference(void) const
   return m_reference ;
   }
 
+int HDF5::Dataset::column(void) const
+/*---------------------------------*/
+{
+  return m_index ;
+  }
+
+void HDF5::Dataset::set_parent(std::shared_ptr<HDF5::Dataset> parent)
+/*-----------------------------------------------------------------*/
+{
+  m_parent = parent ;
+  }
+
+void HDF5::Dataset::set_writer(std::shared_ptr<HDF5::AsyncWriter> writer)
+/*---------------------------------------------------------------------*/
+{
+  wait() ;
+  m_writer = writer ;
+  }
+
+void HDF5::Dataset::set_error_handler(const HDF5::ErrorHandler &handler)
+/*--------------------------------------------------------------------*/
+{
+  m_error_handler = handler ;
+  }
+
+// Queue an append for the writer thread, unless writing directly (which
+// the writer itself does). Returns true if the append was queued.
+template<typename T> bool HDF5::Dataset::queue(const T *data, ssize_t size, int nsignals, bool raw)
+/*-----------------------------------------------------------------------------------------------*/
+{
+  if (m_writer == nullptr || m_writer->in_writer()) return false ;
+  HDF5::AsyncWriter::Task &task = m_writer->next_task() ;
+  task.dataset = this ;
+  task.data.assign(data, data + size) ;
+  task.nsignals = nsignals ;
+  task.raw = raw ;
+  m_writer->push_task() ;
+  return true ;
+  }
+
+// Wait for the writer thread to finish any queued appends before
+// we use the dataset.
+void HDF5::Dataset::wait(void) const
+/*--------------------------------*/
+{
+  if (m_writer != nullptr && !m_writer->in_writer()) m_writer->sync() ;
+  }
+
+
+void HDF5::Dataset::set_live(bool live)
+/*-----------------------------------*/
+{
+  m_live = live ;
+  if (m_pyramid != nullptr) m_pyramid->set_live(live) ;
+  if (m_summary != nullptr) m_summary->set_live(live) ;
+  }
+
+// Pick up rows appended by a SWMR writer when reading past the end.
+void HDF5::Dataset::refresh_to(size_t pos, size_t length)
+/*-----------------------------------------------------*/
+{
+  if (m_live && (m_rank == 0 || pos >= m_shape[0] || length > m_shape[0] - pos)) refresh() ;
+  }
+
+// A single extent refresh and hyperslab read, however long the dataset.
+std::vector<double> HDF5::Dataset::read_tail(size_t pos)
+/*----------------------------------------------------*/
+{
+  std::vector<double> points ;
+  flush() ;
+  refresh() ;
+  if (m_rank == 0 || pos >= m_shape[0]) return points ;
+  size_t size = m_shape[0] - pos ;
+  points.resize((m_index >= 0) ? size : size*m_rowsize) ;
+  read(pos, size, points.data()) ;
+  return points ;
+  }
+
+// Cache the dataset's extent (and that of any clock) so that the append
+// and read paths don't need to query the file.
+void HDF5::Dataset::refresh(void)
+/*-----------------------------*/
+{
+  if (m_dataset.getId() < 0) return ;
+  if (m_live) H5Drefresh(m_dataset.getId()) ;
+  H5::DataSpace dspace = m_dataset.getSpace() ;
+  m_rank = dspace.getSimpleExtentNdims() ;
+  if (m_rank > H5S_MAX_RANK) throw HDF5::Exception("Dataset has too many dimensions: " + m_uri) ;
+  m_shape.resize(m_rank) ;
+  dspace.getSimpleExtentDims(m_shape.data()) ;
+  m_rowsize = 1 ;
+  for (int n = 1 ;  n < m_rank ;  ++n) m_rowsize *= m_shape[n] ;
+  if (m_clockset.getId() >= 0) {
+    hsize_t cshape[H5S_MAX_RANK] ;
+    m_clockset.getSpace().getSimpleExtentDims(cshape) ;
+    m_clocksize = cshape[0] ;
+    }
+  }
+
+
+hsize_t HDF5::Dataset::chunk_rows(void) const
+/*-----------------------------------------*/
+{
+  return m_chunkrows ;
+  }
+
+// Choose a prime number of hash slots, around 100 times the number
+// of default-sized chunks the cache can hold.
+static size_t cache_slots(const HDF5::ChunkCache &cache)
+/*----------------------------------------------------*/
+{
+  if (cache.slots > 0) return cache.slots ;
+  size_t slots = std::max((size_t)521, 100*(cache.bytes/BSML_H5_CHUNK_BYTES)) | 1 ;
+  for (;;) {
+    size_t n = 3 ;
+    while (n*n <= slots && slots % n != 0) n += 2 ;
+    if (n*n > slots) return slots ;
+    slots += 2 ;
+    }
+  }
+
+void HDF5::Dataset::set_chunk_cache(const HDF5::ChunkCache &cache)
+/*--------------------------------------------------------------*/
+{
+  wait() ;
+  if (m_dataset.getId() < 0) return ;
+  flush() ;
+  H5::DSetAccPropList access ;
+  if (cache.bytes > 0) access.setChunkCache(cache_slots(cache), cache.bytes, cache.preemption) ;
+  else access.setChunkCache(H5D_CHUNK_CACHE_NSLOTS_DEFAULT, H5D_CHUNK_CACHE_NBYTES_DEFAULT,
+                            H5D_CHUNK_CACHE_W0_DEFAULT) ;
+  try {
+    // A dataset's cache is set when it is opened, so close and reopen it.
+    std::string path = name() ;
+    H5::Group root = m_dataset.openGroup("/") ;
+    m_dataset.close() ;
+    m_dataset = root.openDataSet(path, access) ;
+    }
+  catch (const H5::Exception &e) {
+    throw HDF5::Exception("Cannot reopen dataset '" + m_uri + "': " + e.getDetailMsg()) ;
+    }
+  size_t slots, bytes ;
+  double preemption ;
+  m_dataset.getAccessPlist().getChunkCache(slots, bytes, preemption) ;
+  if (cache.bytes > 0 && bytes != cache.bytes)
+    throw HDF5::Exception("Dataset '" + m_uri + "' is open elsewhere so its cache can't be changed") ;
+  set_cache_capacity() ;
+  }
+
+void HDF5::Dataset::set_cache_capacity(void)
+/*----------------------------------------*/
+{
+  if (m_chunkrows == 0) return ;
+  size_t slots, bytes ;
+  double preemption ;
+  m_dataset.getAccessPlist().getChunkCache(slots, bytes, preemption) ;
+  size_t chunkbytes = m_chunkrows*m_chunkcols*m_dataset.getDataType().getSize() ;
+  for (int n = 2 ;  n < m_rank ;  ++n) chunkbytes *= m_shape[n] ;
+  m_chunkcounter.set_capacity(bytes/chunkbytes) ;
+  }
+
+HDF5::CacheStatistics HDF5::Dataset::cache_statistics(void) const
+/*-------------------------------------------------------------*/
+{
+  wait() ;
+  return m_chunkcounter.statistics() ;
+  }
+
+// Count the chunks that reading `rows` rows from `pos` uses.
+void HDF5::Dataset::count_chunks(hsize_t pos, hsize_t rows)
+/*-------------------------------------------------------*/
+{
+  if (m_chunkrows == 0 || rows == 0) return ;
+  hsize_t columns = (m_rank > 1) ? (m_shape[1] + m_chunkcols - 1)/m_chunkcols : 1 ;
+  if (m_index >= 0) count_chunks(pos, rows, m_index/m_chunkcols, m_index/m_chunkcols) ;
+  else              count_chunks(pos, rows, 0, columns - 1) ;
+  }
+
+// Count the chunks in columns of chunks `first` to `last` that reading
+// `rows` rows from `pos` uses.
+void HDF5::Dataset::count_chunks(hsize_t pos, hsize_t rows, hsize_t first, hsize_t last)
+/*------------------------------------------------------------------------------------*/
+{
+  if (m_chunkrows == 0 || rows == 0) return ;
+  hsize_t columns = (m_rank > 1) ? (m_shape[1] + m_chunkcols - 1)/m_chunkcols : 1 ;
+  for (hsize_t r = pos/m_chunkrows ;  r <= (pos + rows - 1)/m_chunkrows ;  ++r) {
+    for (hsize_t c = first ;  c <= last ;  ++c) m_chunkcounter.access(r*columns + c) ;
+    }
+  }
+
+
+HDF5::StorageOptions HDF5::Dataset::storage_options(void) const
+/*-----------------------------------------------------------*/
+{
+  wait() ;
+  HDF5::StorageOptions options(BSML_H5_COMPRESS_NONE) ;
+  options.gain = m_gain ;
+  options.offset = m_offset ;
+  if (m_integer) options.datatype = (m_dataset.getDataType().getSize() <= 2) ? BSML_H5_INT16 : BSML_H5_INT32 ;
+  else if (m_dataset.getDataType().getSize() == 4) options.datatype = BSML_H5_FLOAT32 ;
+  H5::DSetCreatPropList props = m_dataset.getCreatePlist() ;
+  if (props.getLayout() == H5D_CHUNKED) {
+    hsize_t chunks[H5S_MAX_RANK] ;
+    props.getChunk(m_rank, chunks) ;
+    options.chunk_shape.assign(chunks, chunks + m_rank) ;
+    }
+  int nfilters = props.getNfilters() ;
+  for (int n = 0 ;  n < nfilters ;  ++n) {
+    unsigned int flags, config ;
+    unsigned int values[8] ;
+    size_t nvalues = 8 ;
+    char name[64] ;
+    H5Z_filter_t filter = props.getFilter(n, flags, nvalues, values, sizeof(name), name, config) ;
+    switch (filter) {
+     case H5Z_FILTER_SHUFFLE:
+      options.shuffle = true ;
+      break ;
+     case H5Z_FILTER_DEFLATE:
+      options.compression = BSML_H5_COMPRESS_GZIP ;
+      if (nvalues > 0) options.level = values[0] ;
+      break ;
+     case H5Z_FILTER_SZIP:
+      options.compression = BSML_H5_COMPRESS_SZIP ;
+      break ;
+     case BSML_H5_FILTER_LZ4:
+      options.compression = BSML_H5_COMPRESS_LZ4 ;
+      break ;
+     case BSML_H5_FILTER_ZSTD:
+      options.compression = BSML_H5_COMPRESS_ZSTD ;
+      if (nvalues > 0) options.level = values[0] ;
+      break ;
+     case BSML_H5_FILTER_BLOSC:
+      options.compression = BSML_H5_COMPRESS_BLOSC ;
+      if (nvalues > 5) {
+        options.level = values[4] ;
+        options.shuffle = (values[5] != 0) ;
+        }
+      break ;
+     default:
+      break ;
+      }
+    }
+  std::shared_ptr<HDF5::Pyramid> levels = pyramid() ;
+  if (levels != nullptr) {
+    options.pyramid_levels = levels->levels() ;
+    options.pyramid_factor = levels->factor() ;
+    }
+  options.chunk_summaries = (summary() != nullptr) ;
+  return options ;
+  }
+
 
+// The size includes any points held in the append buffer.
 size_t HDF5::Dataset::size(void) const
 /*----------------------------------*/
 {
-  if (m_dataset.getId() < 0) return 0 ;
-  else {
-    H5::DataSpace dspace = m_dataset.getSpace() ;
-    hsize_t *shape = (hsize_t *)calloc(dspace.getSimpleExtentNdims(), sizeof(hsize_t)) ;
-    dspace.getSimpleExtentDims(shape) ;
-    hsize_t result = shape[0] ;
-    free(shape) ;
-    return result ;
-    }
+  wait() ;
+  if (m_parent != nullptr) return m_parent->size() ;
+  if (m_rank == 0) return 0 ;
+  else             return m_shape[0] + m_buffer.size()/m_rowsize ;
   }
 
 std::string HDF5::Dataset::name(void) const
@@ -167,125 +549,1065 @@ std::string HDF5::Dataset::name(void) const
   return result ;
   }
 
-int64_t HDF5::Dataset::clock_size(void)
+// The number of times in the dataset's clock, or -1 if it has no clock.
+int64_t HDF5::Dataset::clock_size(size_t required)
+/*----------------------------------------------*/
+{
+  if (m_clock != nullptr) return m_clock->size() ;
+  if (m_clocksize >= 0 && (size_t)m_clocksize < required) {
+    hsize_t cshape[H5S_MAX_RANK] ;             // A clock only grows, so check
+    m_clockset.getSpace().getSimpleExtentDims(cshape) ;   // if it's been extended
+    m_clocksize = cshape[0] ;
+    }
+  return m_clocksize ;
+  }
+
+void HDF5::Dataset::set_clock(std::shared_ptr<HDF5::ClockData> clock)
+/*-----------------------------------------------------------------*/
+{
+  m_clock = clock ;
+  }
+
+
+void HDF5::Dataset::set_buffer_size(size_t size, HDF5::H5BufferUnits units)
+/*-----------------------------------------------------------------------*/
+{
+  flush() ;
+  hsize_t rows = size ;
+  if (units == BSML_H5_BUFFER_BYTES) {
+    rows = size/(m_rowsize*m_dataset.getDataType().getSize()) ;
+    if (size > 0 && rows == 0) rows = 1 ;   // Less than a row still buffers, a chunk at least
+    }
+  if (rows > 0 && m_chunkrows > 0) rows = m_chunkrows*((rows + m_chunkrows - 1)/m_chunkrows) ;
+  m_buffer_rows = rows ;
+  m_buffer.reserve(m_buffer_rows*m_rowsize) ;
+  }
+
+void HDF5::Dataset::flush(void)
+/*---------------------------*/
+{
+  wait() ;
+  if (m_parent != nullptr) {     // Points are appended to the parent
+    m_parent->flush() ;
+    m_shape[0] = m_parent->m_shape[0] ;
+    }
+  if (m_buffer.size() > 0) {
+    write(m_buffer.data(), m_buffer.size()/m_rowsize) ;
+    m_buffer.clear() ;
+    }
+  if (m_pyramid != nullptr) m_pyramid->flush() ;
+  if (m_summary != nullptr) m_summary->flush() ;
+  }
+
+
+void HDF5::Dataset::extend(const double *data, ssize_t size, int nsignals)
+/*----------------------------------------------------------------------*/
+{
+  if (queue(data, size, nsignals, false)) return ;
+  if (m_gain == 1.0 && m_offset == 0.0 && !m_integer) {
+    append(data, size, nsignals) ;
+    return ;
+    }
+  std::vector<double> stored(size) ;
+  for (ssize_t n = 0 ;  n < size ;  ++n) {
+    double value = (data[n] - m_offset)/m_gain ;
+    if (m_integer) {
+      if (std::isnan(value))      // Would be undefined when cast to an integer
+        throw HDF5::Exception("Cannot store NaN in integer dataset '" + m_uri + "'") ;
+      value = std::min(std::max(std::nearbyint(value), m_minstored), m_maxstored) ;
+      }
+    stored[n] = value ;
+    }
+  append(stored.data(), size, nsignals) ;
+  }
+
+template<typename T> void HDF5::Dataset::extend_raw(const T *data, ssize_t size, int nsignals)
+/*------------------------------------------------------------------------------------------*/
+{
+  if (queue(data, size, nsignals, true)) return ;
+  std::vector<double> stored(data, data + size) ;  // Exact, as doubles hold 32-bit integers
+  append(stored.data(), size, nsignals) ;
+  }
+
+void HDF5::Dataset::extend(const int16_t *data, ssize_t size, int nsignals)
+/*-----------------------------------------------------------------------*/
+{
+  extend_raw(data, size, nsignals) ;
+  }
+
+void HDF5::Dataset::extend(const int32_t *data, ssize_t size, int nsignals)
+/*-----------------------------------------------------------------------*/
+{
+  extend_raw(data, size, nsignals) ;
+  }
+
+// Append values that have already been converted for storage,
+// buffering them if the dataset has an append buffer.
+void HDF5::Dataset::append(const double *data, ssize_t size, int nsignals)
+/*----------------------------------------------------------------------*/
+{
+  hsize_t rows = append_rows(size, nsignals) ;
+  // Whole buffers are written directly when nothing is buffered, keeping
+  // later writes aligned, and the remainder is buffered.
+  hsize_t direct = (m_buffer_rows == 0) ? rows
+                 : (m_buffer.size() == 0) ? m_buffer_rows*(rows/m_buffer_rows)
+                 : 0 ;
+  if (direct > 0) write(data, direct) ;
+  if (direct < rows) {
+    m_buffer.insert(m_buffer.end(), data + direct*m_rowsize, data + rows*m_rowsize) ;
+    write_buffer() ;
+    }
+  }
+
+// Check that `size` values can be appended, returning the number of rows they fill.
+hsize_t HDF5::Dataset::append_rows(ssize_t size, int nsignals)
+/*----------------------------------------------------------*/
+{
+  if (m_parent != nullptr)
+    throw HDF5::Exception("Signal '" + m_uri + "' is part of an array, so extend the array") ;
+  if (nsignals > 1 && m_rank != 2)
+    throw HDF5::Exception("Compound dataset has wrong shape: " + m_uri) ;
+  hsize_t rows = (nsignals > 1) ? size/nsignals : size/m_rowsize ;
+
+  size_t newsize = this->size() + rows ;
+  int64_t clocksize = this->clock_size(newsize) ;
+  if (clocksize >= 0 && (size_t)clocksize < newsize)
+    throw HDF5::Exception("Clock for '" + m_uri + "' doesn't have sufficient times") ;
+  return rows ;
+  }
+
+// Write whole buffers of buffered data, keeping any remainder.
+void HDF5::Dataset::write_buffer(void)
+/*----------------------------------*/
+{
+  hsize_t buffered = m_buffer.size()/m_rowsize ;
+  if (buffered >= m_buffer_rows) {
+    hsize_t count = m_buffer_rows*(buffered/m_buffer_rows) ;
+    write(m_buffer.data(), count) ;
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + count*m_rowsize) ;
+    }
+  }
+
+// Interleaving is done straight into the append buffer when
+// points are buffered and stored without scaling.
+void HDF5::Dataset::extend(const double *const *planes, size_t rows)
+/*----------------------------------------------------------------*/
+{
+  if (m_rank != 2) throw HDF5::Exception("Compound dataset has wrong shape: " + m_uri) ;
+  size_t size = rows*m_rowsize ;
+  if (m_writer != nullptr && !m_writer->in_writer()) {
+    HDF5::AsyncWriter::Task &task = m_writer->next_task() ;
+    task.dataset = this ;
+    task.data.resize(size) ;
+    data::interleave(planes, m_rowsize, rows, task.data.data()) ;
+    task.nsignals = m_rowsize ;
+    task.raw = false ;
+    m_writer->push_task() ;
+    return ;
+    }
+  if (m_gain == 1.0 && m_offset == 0.0 && !m_integer
+   && m_buffer_rows > 0 && !(m_buffer.size() == 0 && rows >= m_buffer_rows)) {
+    append_rows(size, m_rowsize) ;
+    size_t used = m_buffer.size() ;
+    m_buffer.resize(used + size) ;
+    data::interleave(planes, m_rowsize, rows, m_buffer.data() + used) ;
+    write_buffer() ;
+    }
+  else {
+    std::vector<double> interleaved(size) ;
+    data::interleave(planes, m_rowsize, rows, interleaved.data()) ;
+    extend(interleaved.data(), size, m_rowsize) ;
+    }
+  }
+
+
+// Append `rows` rows of data to the dataset on file.
+void HDF5::Dataset::write(const double *data, hsize_t rows)
+/*-------------------------------------------------------*/
+{
+  if (m_clock != nullptr) m_clock->flush() ;  // Clock times must be on file first
+
+  hsize_t count[H5S_MAX_RANK], start[H5S_MAX_RANK] ;
+  for (int n = 1 ;  n < m_rank ;  ++n) {
+    start[n] = 0 ;
+    count[n] = m_shape[n] ;
+    }
+  start[0] = m_shape[0] ;
+  count[0] = rows ;
+  m_shape[0] += rows ;
+  try {
+    m_dataset.extend(m_shape.data()) ;
+    H5::DataSpace dspace(m_rank, m_shape.data()) ;
+    dspace.selectHyperslab(H5S_SELECT_SET, count, start) ; // Starting at 'start' for 'count'
+    H5::DataSpace mspace(m_rank, count, count) ;
+    m_dataset.write(data, H5::PredType::NATIVE_DOUBLE, mspace, dspace) ;
+    }
+  catch (H5::DataSetIException e) {
+    m_shape[0] = start[0] ;
+    throw HDF5::Exception("Cannot extend dataset '" + m_uri + "': " + e.getDetailMsg()) ;
+    }
+  if (m_pyramid != nullptr) m_pyramid->add(start[0], data, rows) ;
+  if (m_summary != nullptr) m_summary->add(start[0], data, rows) ;
+  }
+
+
+std::vector<double> HDF5::Dataset::read(size_t pos, ssize_t size)
+/*-------------------------------------------------------------*/
+{
+  std::vector<double> points ;
+
+  flush() ;
+  refresh_to(pos, (size < 0) ? SIZE_MAX : size) ;
+  if (m_rank == 0 || pos >= m_shape[0]) return points ;
+  if (size < 0 || (size + pos) > m_shape[0]) size = m_shape[0] - pos ;
+  points.resize((m_index >= 0) ? size : size*m_rowsize) ;
+  read(pos, size, points.data()) ;
+  return points ;
+  }
+
+
+// Read directly into `buffer`, which must have space for `length` points.
+// Returns the number of points read.
+size_t HDF5::Dataset::read(size_t pos, size_t length, double *buffer)
+/*-----------------------------------------------------------------*/
+{
+  length = read_stored(pos, length, buffer, H5::PredType::NATIVE_DOUBLE) ;
+  if (m_gain != 1.0 || m_offset != 0.0) {
+    size_t count = (m_index >= 0) ? length : length*m_rowsize ;
+    for (size_t n = 0 ;  n < count ;  ++n) buffer[n] = m_gain*buffer[n] + m_offset ;
+    }
+  return length ;
+  }
+
+size_t HDF5::Dataset::read(size_t pos, size_t length, double *const *planes)
+/*------------------------------------------------------------------------*/
+{
+  if (m_rank != 2 || m_index >= 0) throw HDF5::Exception("Compound dataset has wrong shape: " + m_uri) ;
+  flush() ;
+  refresh_to(pos, length) ;
+  if (pos >= m_shape[0]) return 0 ;
+  if ((length + pos) > m_shape[0]) length = m_shape[0] - pos ;
+  // Blocks of whole chunks' rows, if they fit, are read into scratch kept with
+  // the dataset and de-interleaved into the planes while still in cache.
+  size_t block = std::max((size_t)1, (size_t)(BSML_H5_CHUNK_BYTES/(sizeof(double)*m_rowsize))) ;
+  if (m_chunkrows > 0 && m_chunkrows <= block) block -= block % m_chunkrows ;
+  m_scratch.resize(std::min(block, length)*m_rowsize) ;
+  m_scratch_planes.resize(m_rowsize) ;
+  for (size_t row = 0 ;  row < length ;  row += block) {
+    size_t rows = std::min(block, length - row) ;
+    read_rows(pos + row, rows, m_scratch.data()) ;
+    for (size_t c = 0 ;  c < m_rowsize ;  ++c) m_scratch_planes[c] = planes[c] + row ;
+    data::deinterleave(m_scratch.data(), rows, m_rowsize, m_scratch_planes.data()) ;
+    }
+  return length ;
+  }
+
+template<typename T> size_t HDF5::Dataset::read_raw(size_t pos, size_t length, T *buffer)
+/*-------------------------------------------------------------------------------------*/
+{
+  if (!m_integer) throw HDF5::Exception("Dataset '" + m_uri + "' isn't stored as integers") ;
+  return read_stored(pos, length, buffer, (sizeof(T) == sizeof(int16_t)) ? H5::PredType::NATIVE_INT16
+                                                                          : H5::PredType::NATIVE_INT32) ;
+  }
+
+size_t HDF5::Dataset::read(size_t pos, size_t length, int16_t *buffer)
+/*------------------------------------------------------------------*/
+{
+  return read_raw(pos, length, buffer) ;
+  }
+
+size_t HDF5::Dataset::read(size_t pos, size_t length, int32_t *buffer)
+/*------------------------------------------------------------------*/
+{
+  return read_raw(pos, length, buffer) ;
+  }
+
+std::vector<double> HDF5::Dataset::read_columns(const std::vector<hsize_t> &columns, size_t pos, ssize_t length)
+/*-------------------------------------------------------------------------------------------------------------*/
+{
+  std::vector<double> points ;
+
+  flush() ;
+  refresh_to(pos, (length < 0) ? SIZE_MAX : length) ;
+  if (m_rank != 2) throw HDF5::Exception("Compound dataset has wrong shape: " + m_uri) ;
+  if (columns.empty() || pos >= m_shape[0]) return points ;
+  if (length < 0 || (length + pos) > m_shape[0]) length = m_shape[0] - pos ;
+  hsize_t count[2], start[2] ;
+  start[0] = pos ;
+  count[0] = length ;
+  try {
+    H5::DataSpace dspace(m_rank, m_shape.data()) ;
+    for (size_t n = 0 ;  n < columns.size() ;  ) {   // A hyperslab for each run of adjacent columns
+      if (columns[n] >= m_shape[1] || (n > 0 && columns[n] <= columns[n-1]))
+        throw HDF5::Exception("Invalid columns for dataset '" + m_uri + "'") ;
+      start[1] = columns[n] ;
+      count[1] = 1 ;
+      while (++n < columns.size() && columns[n] == start[1] + count[1]) ++count[1] ;
+      dspace.selectHyperslab((start[1] == columns[0]) ? H5S_SELECT_SET : H5S_SELECT_OR, count, start) ;
+      }
+    count[1] = columns.size() ;
+    H5::DataSpace mspace(m_rank, count, count) ;
+    points.resize(length*columns.size()) ;
+    m_dataset.read(points.data(), H5::PredType::NATIVE_DOUBLE, mspace, dspace) ;
+    }
+  catch (const H5::DataSetIException &e) {
+    throw HDF5::Exception("Cannot read dataset '" + m_uri + "': " + e.getDetailMsg()) ;
+    }
+  catch (const H5::DataSpaceIException &e) {
+    throw HDF5::Exception("Cannot select columns of dataset '" + m_uri + "': " + e.getDetailMsg()) ;
+    }
+  if (m_chunkcols > 0) {
+    for (size_t n = 0 ;  n < columns.size() ;  ++n) {
+      hsize_t c = columns[n]/m_chunkcols ;
+      if (n == 0 || c != columns[n-1]/m_chunkcols) count_chunks(pos, length, c, c) ;
+      }
+    }
+  if (m_gain != 1.0 || m_offset != 0.0) {
+    for (auto &p : points) p = m_gain*p + m_offset ;
+    }
+  return points ;
+  }
+
+// Read stored values, converted to `memtype`, into `buffer`.
+size_t HDF5::Dataset::read_stored(size_t pos, size_t length, void *buffer, const H5::DataType &memtype)
+/*--------------------------------------------------------------------------------------------------*/
+{
+  wait() ;
+  flush() ;
+  refresh_to(pos, length) ;
+  if (m_rank == 0 || pos >= m_shape[0]) return 0 ;
+  if ((length + pos) > m_shape[0]) length = m_shape[0] - pos ;
+  hsize_t count[H5S_MAX_RANK], start[H5S_MAX_RANK] ;
+  start[0] = pos ;
+  count[0] = length ;
+  if (m_index >= 0) {         // compound dataset
+    if (m_rank != 2) throw HDF5::Exception("Compound dataset has wrong shape: " + m_uri) ;
+    count[1] = 1 ;
+    start[1] = m_index ;
+    }
+  else {                      // simple dataset
+    for (int n = 1 ;  n < m_rank ;  ++n) {
+      count[n] = m_shape[n] ;
+      start[n] = 0 ;
+      }
+    }
+  count_chunks(pos, length) ;
+  try {
+    H5::DataSpace dspace(m_rank, m_shape.data()) ;
+    dspace.selectHyperslab(H5S_SELECT_SET, count, start) ;
+    H5::DataSpace mspace(m_rank, count, count) ;
+    m_dataset.read(buffer, memtype, mspace, dspace) ;
+    }
+  catch (H5::DataSetIException e) {
+    throw HDF5::Exception("Cannot read dataset '" + m_uri + "': " + e.getDetailMsg()) ;
+    }
+  return length ;
+  }
+
+// Read whole rows of physical values that are on file, without
+// flushing, as a pyramid does while the dataset is being written.
+void HDF5::Dataset::read_rows(hsize_t pos, hsize_t rows, double *buffer)
+/*--------------------------------------------------------------------*/
+{
+  hsize_t count[H5S_MAX_RANK], start[H5S_MAX_RANK] ;
+  start[0] = pos ;
+  count[0] = rows ;
+  for (int n = 1 ;  n < m_rank ;  ++n) {
+    count[n] = m_shape[n] ;
+    start[n] = 0 ;
+    }
+  count_chunks(pos, rows) ;
+  try {
+    H5::DataSpace dspace(m_rank, m_shape.data()) ;
+    dspace.selectHyperslab(H5S_SELECT_SET, count, start) ;
+    H5::DataSpace mspace(m_rank, count, count) ;
+    m_dataset.read(buffer, H5::PredType::NATIVE_DOUBLE, mspace, dspace) ;
+    }
+  catch (const H5::DataSetIException &e) {
+    throw HDF5::Exception("Cannot read dataset '" + m_uri + "': " + e.getDetailMsg()) ;
+    }
+  if (m_gain != 1.0 || m_offset != 0.0) {
+    for (size_t n = 0 ;  n < rows*m_rowsize ;  ++n) buffer[n] = m_gain*buffer[n] + m_offset ;
+    }
+  }
+
+
+// Combine `bin` into `into`, which is empty if it has no points.
+static void merge_bin(HDF5::Bin &into, const HDF5::Bin &bin)
+/*--------------------------------------------------------*/
+{
+  if (into.count == 0) {
+    into = bin ;
+    return ;
+    }
+  into.mean = (into.mean*into.count + bin.mean*bin.count)/(into.count + bin.count) ;
+  into.start = std::min(into.start, bin.start) ;
+  into.count += bin.count ;
+  into.min = std::min(into.min, bin.min) ;
+  into.max = std::max(into.max, bin.max) ;
+  }
+
+// Merge runs of successive bins so there are no more than `maxbins`.
+static void merge_bins(std::vector<HDF5::Bin> &bins, size_t maxbins)
+/*----------------------------------------------------------------*/
+{
+  if (bins.size() <= maxbins) return ;
+  size_t group = (bins.size() + maxbins - 1)/maxbins ;
+  size_t merged = 0 ;
+  for (size_t n = 0 ;  n < bins.size() ;  ++n) {
+    if (n % group == 0) bins[merged++] = bins[n] ;
+    else merge_bin(bins[merged - 1], bins[n]) ;
+    }
+  bins.resize(merged) ;
+  }
+
+std::vector<HDF5::Bin> HDF5::Dataset::envelope(size_t pos, ssize_t length, size_t maxbins)
+/*--------------------------------------------------------------------------------------*/
+{
+  if (m_index < 0 && m_rowsize != 1)
+    throw HDF5::Exception("Dataset '" + m_uri + "' has more than one value at each point") ;
+  return envelope(std::vector<hsize_t>(1, std::max(m_index, 0)), pos, length, maxbins)[0] ;
+  }
+
+// Without a pyramid every point is read, a chunk's rows at a time, and
+// all columns are binned in the same pass.
+std::vector<std::vector<HDF5::Bin>> HDF5::Dataset::envelope(const std::vector<hsize_t> &columns,
+/*--------------------------------------------------------------------------------------------*/
+                                                            size_t pos, ssize_t length, size_t maxbins)
+{
+  std::vector<std::vector<HDF5::Bin>> bins(columns.size()) ;
+  for (auto column : columns) {
+    if (column >= m_rowsize) throw HDF5::Exception("Dataset '" + m_uri + "' has no such column") ;
+    }
+  flush() ;
+  refresh_to(pos, (length < 0) ? SIZE_MAX : length) ;
+  if (m_rank == 0 || pos >= m_shape[0] || maxbins == 0) return bins ;
+  size_t end = (length < 0 || (size_t)length > m_shape[0] - pos) ? m_shape[0] : pos + length ;
+  std::shared_ptr<HDF5::Pyramid> levels = pyramid() ;
+  if (levels != nullptr) {
+    for (size_t c = 0 ;  c < columns.size() ;  ++c) bins[c] = levels->envelope(columns[c], pos, end, maxbins) ;
+    return bins ;
+    }
+
+  size_t group = (end - pos + maxbins - 1)/maxbins ;
+  hsize_t block = std::max(m_chunkrows, (hsize_t)BSML_H5_CHUNK_MIN_ROWS) ;
+  std::vector<double> buffer(block*m_rowsize) ;
+  std::vector<HDF5::Bin> current(columns.size(), HDF5::Bin{ pos, 0, 0.0, 0.0, 0.0 }) ;
+  for (size_t row = pos ;  row < end ;  row += block) {
+    hsize_t rows = std::min((size_t)block, end - row) ;
+    read_rows(row, rows, buffer.data()) ;
+    for (hsize_t r = 0 ;  r < rows ;  ++r) {
+      const double *values = buffer.data() + r*m_rowsize ;
+      for (size_t c = 0 ;  c < columns.size() ;  ++c) {
+        double value = values[columns[c]] ;
+        merge_bin(current[c], HDF5::Bin{ row + r, 1, value, value, value }) ;
+        if (current[c].count == group) {
+          bins[c].push_back(current[c]) ;
+          current[c].count = 0 ;
+          }
+        }
+      }
+    }
+  for (size_t c = 0 ;  c < columns.size() ;  ++c) {
+    if (current[c].count > 0) bins[c].push_back(current[c]) ;
+    }
+  return bins ;
+  }
+
+bool HDF5::Dataset::has_pyramid(void) const
+/*---------------------------------------*/
+{
+  return pyramid() != nullptr ;
+  }
+
+// Without chunk summaries every point is read, a block of chunks at a time.
+data::Statistics HDF5::Dataset::statistics(size_t pos, ssize_t length)
+/*------------------------------------------------------------------*/
+{
+  if (m_index < 0 && m_rowsize != 1)
+    throw HDF5::Exception("Dataset '" + m_uri + "' has more than one value at each point") ;
+  flush() ;
+  refresh_to(pos, (length < 0) ? SIZE_MAX : length) ;
+  if (m_rank == 0 || pos >= m_shape[0]) return data::Statistics() ;
+  size_t end = (length < 0 || (size_t)length > m_shape[0] - pos) ? m_shape[0] : pos + length ;
+  std::shared_ptr<HDF5::ChunkSummary> blocks = summary() ;
+  if (blocks != nullptr) return blocks->statistics(std::max(m_index, 0), pos, end) ;
+
+  auto reader = [this, pos](size_t offset, size_t length, double *buffer) -> size_t {
+    return read(pos + offset, length, buffer) ;
+    } ;
+  return data::statistics(reader, end - pos, std::max(m_chunkrows, (hsize_t)BSML_H5_CHUNK_MIN_ROWS)) ;
+  }
+
+bool HDF5::Dataset::has_summary(void) const
+/*---------------------------------------*/
+{
+  return summary() != nullptr ;
+  }
+
+
+HDF5::Pyramid::Pyramid(HDF5::Dataset *dataset, const H5::Group &group)
+/*==================================================================*/
+: m_dataset(dataset),
+  m_factor(0),
+  m_columns(dataset->m_rowsize),
+  m_restored(false)
+{
+  uint64_t factor = 0 ;
+  uint64_t levels = 0 ;
+  try {
+    H5::Attribute attr = group.openAttribute("factor") ;
+    attr.read(H5::PredType::NATIVE_UINT64, &factor) ;
+    attr.close() ;
+    attr = group.openAttribute("levels") ;
+    attr.read(H5::PredType::NATIVE_UINT64, &levels) ;
+    attr.close() ;
+    std::string groupname = group.getObjName() ;
+    for (uint64_t level = 1 ;  level <= levels ;  ++level) {
+      std::string levelname = std::to_string(level) ;
+      m_levels.push_back(std::make_shared<HDF5::Dataset>(groupname + "/" + levelname,
+                                                         HDF5::DatasetRef(group.openDataSet(levelname), 0))) ;
+      }
+    }
+  catch (const H5::Exception &e) {
+    throw HDF5::Exception("Cannot open pyramid for '" + dataset->m_uri + "': " + e.getDetailMsg()) ;
+    }
+  if (factor < 2) throw HDF5::Exception("Pyramid for '" + dataset->m_uri + "' has an invalid factor") ;
+  m_factor = factor ;
+  m_accumulators.resize(m_levels.size()) ;
+  for (auto &acc : m_accumulators) {
+    acc.min.resize(m_columns) ;
+    acc.max.resize(m_columns) ;
+    acc.sum.resize(m_columns) ;
+    acc.count = 0 ;
+    }
+  }
+
+size_t HDF5::Pyramid::factor(void) const
+/*------------------------------------*/
+{
+  return m_factor ;
+  }
+
+size_t HDF5::Pyramid::levels(void) const
+/*------------------------------------*/
+{
+  return m_levels.size() ;
+  }
+
+void HDF5::Pyramid::add(hsize_t pos, const double *stored, hsize_t rows)
+/*--------------------------------------------------------------------*/
+{
+  if (m_levels.empty()) return ;
+  if (!m_restored) restore(pos) ;
+  const double gain = m_dataset->m_gain ;
+  const double offset = m_dataset->m_offset ;
+  Accumulator &acc = m_accumulators[0] ;
+  for (hsize_t r = 0 ;  r < rows ;  ++r) {
+    const double *row = stored + r*m_columns ;
+    if (acc.count == 0) {
+      for (size_t c = 0 ;  c < m_columns ;  ++c)
+        acc.min[c] = acc.max[c] = acc.sum[c] = gain*row[c] + offset ;
+      }
+    else {
+      for (size_t c = 0 ;  c < m_columns ;  ++c) {
+        double value = gain*row[c] + offset ;
+        if (value < acc.min[c]) acc.min[c] = value ;
+        if (value > acc.max[c]) acc.max[c] = value ;
+        acc.sum[c] += value ;
+        }
+      }
+    if (++acc.count == m_factor) complete(1) ;
+    }
+  append_rows() ;
+  }
+
+// Add a row of the level below (as minimum, maximum and mean triples) to `level`.
+void HDF5::Pyramid::accumulate(size_t level, const double *summary)
+/*---------------------------------------------------------------*/
+{
+  Accumulator &acc = m_accumulators[level - 1] ;
+  if (acc.count == 0) {
+    for (size_t c = 0 ;  c < m_columns ;  ++c) {
+      acc.min[c] = summary[3*c] ;
+      acc.max[c] = summary[3*c + 1] ;
+      acc.sum[c] = summary[3*c + 2] ;
+      }
+    }
+  else {
+    for (size_t c = 0 ;  c < m_columns ;  ++c) {
+      acc.min[c] = std::min(acc.min[c], summary[3*c]) ;
+      acc.max[c] = std::max(acc.max[c], summary[3*c + 1]) ;
+      acc.sum[c] += summary[3*c + 2] ;
+      }
+    }
+  if (++acc.count == m_factor) complete(level) ;
+  }
+
+// Append the row that `level` has accumulated, passing it up to the next level.
+void HDF5::Pyramid::complete(size_t level)
+/*--------------------------------------*/
+{
+  Accumulator &acc = m_accumulators[level - 1] ;
+  size_t used = acc.rows.size() ;
+  acc.rows.resize(used + 3*m_columns) ;
+  double *row = acc.rows.data() + used ;
+  for (size_t c = 0 ;  c < m_columns ;  ++c) {
+    row[3*c] = acc.min[c] ;
+    row[3*c + 1] = acc.max[c] ;
+    row[3*c + 2] = acc.sum[c]/m_factor ;   // Means of equal-sized blocks
+    }
+  acc.count = 0 ;
+  if (level < m_levels.size()) accumulate(level + 1, row) ;
+  }
+
+void HDF5::Pyramid::append_rows(void)
+/*---------------------------------*/
+{
+  for (size_t level = 1 ;  level <= m_levels.size() ;  ++level) {
+    std::vector<double> &rows = m_accumulators[level - 1].rows ;
+    if (rows.empty()) continue ;
+    m_levels[level - 1]->extend(rows.data(), rows.size(), 3*m_columns) ;
+    rows.clear() ;
+    }
+  }
+
+// Rebuild the partial rows of a pyramid being extended, from the rows of
+// each level below that are past its last complete row. Coarser levels
+// are done first, so rows that finer ones complete are passed up to them.
+void HDF5::Pyramid::restore(hsize_t pos)
+/*------------------------------------*/
+{
+  m_restored = true ;
+  for (auto level : m_levels) level->set_buffer_size(level->chunk_rows()) ;   // Only once written
+  for (size_t level = m_levels.size() ;  level > 0 ;  --level) {
+    m_accumulators[level - 1].count = 0 ;
+    size_t first = level_rows(level)*m_factor ;
+    size_t last = (level == 1) ? pos : level_rows(level - 1) ;
+    if (first >= last) continue ;
+    size_t rows = last - first ;
+    std::vector<double> summary(3*m_columns*rows) ;
+    if (level == 1) {
+      std::vector<double> values(m_columns*rows) ;
+      m_dataset->read_rows(first, rows, values.data()) ;
+      for (size_t n = 0 ;  n < values.size() ;  ++n)
+        summary[3*n] = summary[3*n + 1] = summary[3*n + 2] = values[n] ;
+      }
+    else {
+      rows = m_levels[level - 2]->read(first, rows, summary.data()) ;
+      }
+    for (size_t r = 0 ;  r < rows ;  ++r) accumulate(level, summary.data() + 3*m_columns*r) ;
+    append_rows() ;
+    }
+  }
+
+size_t HDF5::Pyramid::level_rows(size_t level) const
+/*------------------------------------------------*/
+{
+  return m_levels[level - 1]->size() ;
+  }
+
+void HDF5::Pyramid::flush(void)
+/*---------------------------*/
+{
+  for (auto level : m_levels) level->flush() ;
+  }
+
+void HDF5::Pyramid::close(void)
+/*---------------------------*/
+{
+  for (auto level : m_levels) level->close() ;
+  }
+
+void HDF5::Pyramid::set_live(bool live)
 /*-----------------------------------*/
 {
+  for (auto level : m_levels) level->set_live(live) ;
+  }
+
+// Each row of `level` from `first` up to `last` is a bin.
+void HDF5::Pyramid::read_level(size_t level, int column, size_t first, size_t last,
+/*--------------------------------------------------------------------------------*/
+                               std::vector<HDF5::Bin> &bins)
+{
+  if (first >= last) return ;
+  size_t span = 1 ;
+  for (size_t l = 0 ;  l < level ;  ++l) span *= m_factor ;
+  size_t width = (level == 0) ? m_columns : 3*m_columns ;
+  std::vector<double> rows((last - first)*width) ;
+  if (level == 0) m_dataset->read_rows(first, last - first, rows.data()) ;
+  else last = first + m_levels[level - 1]->read(first, last - first, rows.data()) ;
+  for (size_t r = first ;  r < last ;  ++r) {
+    const double *row = rows.data() + (r - first)*width ;
+    if (level == 0)
+      bins.push_back(HDF5::Bin{ r, 1, row[column], row[column], row[column] }) ;
+    else
+      bins.push_back(HDF5::Bin{ r*span, span, row[3*column], row[3*column + 1], row[3*column + 2] }) ;
+    }
+  }
+
+// A single bin for rows `[start, end)`, from the rows of `level` that
+// they cover and finer levels for the remainder at each end.
+HDF5::Bin HDF5::Pyramid::summarise(size_t level, int column, size_t start, size_t end)
+/*----------------------------------------------------------------------------------*/
+{
+  HDF5::Bin bin = { start, 0, 0.0, 0.0, 0.0 } ;
+  std::vector<HDF5::Bin> bins ;
+  if (level == 0) {
+    read_level(0, column, start, end, bins) ;
+    }
+  else {
+    size_t span = 1 ;
+    for (size_t l = 0 ;  l < level ;  ++l) span *= m_factor ;
+    size_t first = (start + span - 1)/span ;
+    size_t last = std::min(end/span, level_rows(level)) ;
+    if (first >= last) return summarise(level - 1, column, start, end) ;
+    if (start < first*span) bins.push_back(summarise(level - 1, column, start, first*span)) ;
+    read_level(level, column, first, last, bins) ;
+    if (last*span < end) bins.push_back(summarise(level - 1, column, last*span, end)) ;
+    }
+  for (auto const &b : bins) merge_bin(bin, b) ;
+  return bin ;
+  }
+
+std::vector<HDF5::Bin> HDF5::Pyramid::envelope(int column, size_t start, size_t end, size_t maxbins)
+/*------------------------------------------------------------------------------------------------*/
+{
+  std::vector<HDF5::Bin> bins ;
+  if (start >= end || maxbins == 0) return bins ;
+  if (m_dataset->m_live) {
+    for (auto level : m_levels) level->refresh() ;
+    }
+  size_t level = 0 ;
+  size_t span = 1 ;
+  // Read no more than `factor` rows for each bin, merging them as necessary
+  while (level < m_levels.size() && (end - start)/span + ((level > 0) ? 2 : 0) > maxbins*m_factor) {
+    ++level ;
+    span *= m_factor ;
+    }
+  if (level == 0) {
+    read_level(0, column, start, end, bins) ;
+    }
+  else {
+    size_t first = (start + span - 1)/span ;
+    size_t last = std::min(end/span, level_rows(level)) ;
+    if (first >= last) {
+      bins.push_back(summarise(level - 1, column, start, end)) ;
+      }
+    else {
+      if (start < first*span) bins.push_back(summarise(level - 1, column, start, first*span)) ;
+      read_level(level, column, first, last, bins) ;
+      if (last*span < end) bins.push_back(summarise(level - 1, column, last*span, end)) ;
+      }
+    }
+  merge_bins(bins, maxbins) ;
+  return bins ;
+  }
+
+
+HDF5::ChunkSummary::ChunkSummary(HDF5::Dataset *dataset, const H5::DataSet &summary)
+/*=================================================================================*/
+: m_dataset(dataset),
+  m_rows(0),
+  m_columns(dataset->m_rowsize),
+  m_partial(1 + 4*dataset->m_rowsize, 0.0),
+  m_restored(false)
+{
+  uint64_t rows = 0 ;
   try {
-    H5::Attribute attr = m_dataset.openAttribute("clock") ;
-    hobj_ref_t ref ;
-    attr.read(H5::PredType::STD_REF_OBJ, &ref) ;
+    H5::Attribute attr = summary.openAttribute("rows") ;
+    attr.read(H5::PredType::NATIVE_UINT64, &rows) ;
     attr.close() ;
-    H5::DataSet clk(H5Rdereference(H5Iget_file_id(m_dataset.getId()), H5P_DEFAULT, H5R_OBJECT, &ref)) ;
-    H5::DataSpace cspace = clk.getSpace() ;
-    int cdims = cspace.getSimpleExtentNdims() ;
-    hsize_t *cshape = (hsize_t *)calloc(cdims, sizeof(hsize_t)) ;
-    cspace.getSimpleExtentDims(cshape) ;
-    hsize_t result = cshape[0] ;
-    free(cshape) ;
-    return result ;
+    m_summary = std::make_shared<HDF5::Dataset>(summary.getObjName(), HDF5::DatasetRef(summary, 0)) ;
     }
-  catch (H5::AttributeIException e) { }
-  return -1 ;
+  catch (const H5::Exception &e) {
+    throw HDF5::Exception("Cannot open chunk summary for '" + dataset->m_uri + "': " + e.getDetailMsg()) ;
+    }
+  if (rows == 0) throw HDF5::Exception("Chunk summary for '" + dataset->m_uri + "' has no rows per block") ;
+  if (m_summary->m_rowsize != m_partial.size())
+    throw HDF5::Exception("Chunk summary for '" + dataset->m_uri + "' has the wrong number of columns") ;
+  m_rows = rows ;
   }
 
+size_t HDF5::ChunkSummary::rows(void) const
+/*---------------------------------------*/
+{
+  return m_rows ;
+  }
 
-void HDF5::Dataset::extend(const double *data, ssize_t size, int nsignals)
-/*----------------------------------------------------------------------*/
+void HDF5::ChunkSummary::add(hsize_t pos, const double *stored, hsize_t rows)
+/*-------------------------------------------------------------------------*/
 {
+  if (!m_restored) restore(pos) ;
+  const double gain = m_dataset->m_gain ;
+  const double offset = m_dataset->m_offset ;
+  if (gain == 1.0 && offset == 0.0) {
+    accumulate(stored, rows) ;
+    }
+  else {
+    std::vector<double> values(rows*m_columns) ;
+    for (size_t n = 0 ;  n < values.size() ;  ++n) values[n] = gain*stored[n] + offset ;
+    accumulate(values.data(), rows) ;
+    }
+  if (!m_completed.empty()) {
+    m_summary->extend(m_completed.data(), m_completed.size(), m_partial.size()) ;
+    m_completed.clear() ;
+    }
+  }
 
-  int64_t clocksize = this->clock_size() ;
+// Add rows of physical values to the partial block, completing it
+// every `m_rows` rows.
+void HDF5::ChunkSummary::accumulate(const double *values, hsize_t rows)
+/*-------------------------------------------------------------------*/
+{
+  double *block = m_partial.data() ;
+  for (hsize_t r = 0 ;  r < rows ;  ++r) {
+    const double *row = values + r*m_columns ;
+    if (block[0] == 0.0) {
+      for (size_t c = 0 ;  c < m_columns ;  ++c) {
+        double *acc = block + 1 + 4*c ;
+        acc[0] = acc[1] = acc[2] = row[c] ;
+        acc[3] = row[c]*row[c] ;
+        }
+      }
+    else {
+      for (size_t c = 0 ;  c < m_columns ;  ++c) {
+        double *acc = block + 1 + 4*c ;
+        if (row[c] < acc[0]) acc[0] = row[c] ;
+        if (row[c] > acc[1]) acc[1] = row[c] ;
+        acc[2] += row[c] ;
+        acc[3] += row[c]*row[c] ;
+        }
+      }
+    block[0] += 1.0 ;
+    if (block[0] == (double)m_rows) {
+      m_completed.insert(m_completed.end(), m_partial.begin(), m_partial.end()) ;
+      block[0] = 0.0 ;
+      }
+    }
+  }
+
+// Rebuild the partial block of a summary being extended, from the rows
+// of the dataset past its last complete block.
+void HDF5::ChunkSummary::restore(hsize_t pos)
+/*-----------------------------------------*/
+{
+  m_restored = true ;
+  m_summary->set_buffer_size(m_summary->chunk_rows()) ;
+  m_partial[0] = 0.0 ;
+  size_t first = m_summary->size()*m_rows ;
+  if (first >= pos) return ;
+  std::vector<double> values((pos - first)*m_columns) ;
+  m_dataset->read_rows(first, pos - first, values.data()) ;
+  accumulate(values.data(), pos - first) ;
+  }
+
+void HDF5::ChunkSummary::flush(void)
+/*--------------------------------*/
+{
+  m_summary->flush() ;
+  }
+
+void HDF5::ChunkSummary::close(void)
+/*--------------------------------*/
+{
+  m_summary->close() ;
+  }
+
+void HDF5::ChunkSummary::set_live(bool live)
+/*----------------------------------------*/
+{
+  m_summary->set_live(live) ;
+  }
+
+// Include `column` of the dataset's rows `[start, end)`, read from file.
+void HDF5::ChunkSummary::read_rows(int column, size_t start, size_t end, data::Statistics &stats)
+/*--------------------------------------------------------------------------------------------*/
+{
+  if (start >= end) return ;
+  std::vector<double> rows((end - start)*m_columns) ;
+  m_dataset->read_rows(start, end - start, rows.data()) ;
+  if (m_columns > 1) {
+    for (size_t r = 0 ;  r < end - start ;  ++r) rows[r] = rows[r*m_columns + column] ;
+    }
+  stats.add(rows.data(), end - start) ;
+  }
+
+data::Statistics HDF5::ChunkSummary::statistics(int column, size_t start, size_t end)
+/*---------------------------------------------------------------------------------*/
+{
+  data::Statistics stats ;
+  if (start >= end) return stats ;
+  if (m_dataset->m_live) m_summary->refresh() ;
+  size_t first = (start + m_rows - 1)/m_rows ;
+  size_t last = std::min(end/m_rows, m_summary->size()) ;
+  if (first >= last) {
+    read_rows(column, start, end, stats) ;
+    return stats ;
+    }
+  read_rows(column, start, first*m_rows, stats) ;
+  const size_t width = m_partial.size() ;
+  const size_t block = std::max(m_summary->chunk_rows(), (hsize_t)1) ;
+  std::vector<double> summary(block*width) ;
+  for (size_t row = first ;  row < last ;  row += block) {
+    size_t count = m_summary->read(row, std::min(block, last - row), summary.data()) ;
+    for (size_t r = 0 ;  r < count ;  ++r) {
+      const double *values = summary.data() + r*width ;
+      const double *acc = values + 1 + 4*column ;
+      stats.merge(data::Statistics((size_t)values[0], acc[0], acc[1], acc[2], acc[3])) ;
+      }
+    }
+  read_rows(column, last*m_rows, end, stats) ;
+  return stats ;
+  }
+
+
+HDF5::AsyncWriter::AsyncWriter(size_t length)
+/*------------------------------------------*/
+: m_head(0),
+  m_tail(0),
+  m_producer(std::thread::id()),
+  m_stopping(false),
+  m_idle(false),
+  m_waiting(false),
+  m_failed(false)
+{
+  size_t slots = 1 ;                // A power of two, so positions wrap with a mask
+  while (slots < length) slots <<= 1 ;
+  m_tasks.resize(slots) ;
+  m_mask = slots - 1 ;
+  m_thread = std::thread(&HDF5::AsyncWriter::run, this) ;
+  }
+
+HDF5::AsyncWriter::~AsyncWriter()
+/*-----------------------------*/
+{
+  stop() ;
+  }
+
+bool HDF5::AsyncWriter::in_writer(void) const
+/*-----------------------------------------*/
+{
+  return std::this_thread::get_id() == m_thread.get_id() ;
+  }
+
+HDF5::AsyncWriter::Task &HDF5::AsyncWriter::next_task(void)
+/*-------------------------------------------------------*/
+{
+  std::thread::id producer ;
+  if (!m_producer.compare_exchange_strong(producer, std::this_thread::get_id())
+   && producer != std::this_thread::get_id())
+    throw HDF5::Exception("Asynchronous writes must all be made from the same thread") ;
+  check_error() ;
+  size_t tail = m_tail.load(std::memory_order_relaxed) ;
+  if (tail - m_head.load(std::memory_order_acquire) > m_mask) {   // Full
+    std::unique_lock<std::mutex> lock(m_mutex) ;
+    m_waiting = true ;
+    m_done.wait(lock, [this, tail]() { return tail - m_head.load() <= m_mask ; }) ;
+    m_waiting = false ;
+    }
+  return m_tasks[tail & m_mask] ;
+  }
+
+void HDF5::AsyncWriter::push_task(void)
+/*-----------------------------------*/
+{
+  m_tail.store(m_tail.load(std::memory_order_relaxed) + 1) ;
+  if (m_idle.load()) {
+    std::lock_guard<std::mutex> lock(m_mutex) ;
+    m_ready.notify_one() ;
+    }
+  }
+
+void HDF5::AsyncWriter::sync(void)
+/*------------------------------*/
+{
+  size_t tail = m_tail.load(std::memory_order_relaxed) ;
+  if (m_head.load() != tail) {
+    std::unique_lock<std::mutex> lock(m_mutex) ;
+    m_waiting = true ;
+    m_done.wait(lock, [this, tail]() { return m_head.load() == tail ; }) ;
+    m_waiting = false ;
+    }
+  check_error() ;
+  }
+
+void HDF5::AsyncWriter::stop(void)
+/*------------------------------*/
+{
+  if (!m_thread.joinable()) return ;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex) ;
+    m_stopping = true ;
+    m_ready.notify_one() ;
+  }
+  m_thread.join() ;
+  }
 
-  H5::DataSpace dspace = m_dataset.getSpace() ;
-  int ndims = dspace.getSimpleExtentNdims() ;
-  hsize_t
-    *shape = (hsize_t *)calloc(ndims, sizeof(hsize_t)),
-    *newshape = (hsize_t *)calloc(ndims, sizeof(hsize_t)),
-    *count = (hsize_t *)calloc(ndims, sizeof(hsize_t)),
-    *start = (hsize_t *)calloc(ndims, sizeof(hsize_t)) ;
-  try {
-    dspace.getSimpleExtentDims(shape) ;
-    if (nsignals > 1) {         // compound dataset
-      if (ndims != 2) throw HDF5::Exception("Compound dataset has wrong shape: " + m_uri) ;
-      start[1] = 0 ;
-      count[0] = size/nsignals ;
-      newshape[1] = count[1] = shape[1] ;
-      }
-    else {                      // simple dataset
-      count[0] = size ;
-      for (int n = 1 ;  n < ndims ;  ++n) {
-        start[n] = 0 ;
-        count[0] /= shape[n] ;
-        newshape[n] = count[n] = shape[n] ;
-        }
-      }
-    start[0] = shape[0] ;
-    newshape[0] = shape[0] + count[0] ;
-    if (clocksize >= 0 && (hsize_t)clocksize < newshape[0])
-      throw HDF5::Exception("Clock for '" + m_uri + "' doesn't have sufficient times") ;
-    m_dataset.extend(newshape) ;
-    dspace = m_dataset.getSpace() ;
-    dspace.selectHyperslab(H5S_SELECT_SET, count, start) ; // Starting at 'start' for 'count'
-    H5::DataSpace mspace(ndims, count, count) ;
-    m_dataset.write(data, H5::PredType::NATIVE_DOUBLE, mspace, dspace) ;
+// Throw, just once, the first error that a write has had.
+void HDF5::AsyncWriter::check_error(void)
+/*-------------------------------------*/
+{
+  if (m_failed.load(std::memory_order_acquire)) {
+    std::string error ;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex) ;
+      error.swap(m_error) ;
     }
-  catch (H5::DataSetIException e) {
-    throw HDF5::Exception("Cannot extend dataset '" + m_uri + "': " + e.getDetailMsg()) ;
+    m_failed = false ;
+    throw HDF5::Exception(error) ;
     }
-  free(shape) ;
-  free(newshape) ;
-  free(count) ;
-  free(start) ;
   }
 
-
-std::vector<double> HDF5::Dataset::read(size_t pos, ssize_t size)
-/*-------------------------------------------------------------*/
+void HDF5::AsyncWriter::fail(const std::string &error)
+/*--------------------------------------------------*/
 {
-  std::vector<double> points ;
+  std::lock_guard<std::mutex> lock(m_mutex) ;
+  m_error = error ;
+  m_failed = true ;
+  }
 
-  H5::DataSpace dspace = m_dataset.getSpace() ;
-  int ndims = dspace.getSimpleExtentNdims() ;
-  hsize_t
-    *shape = (hsize_t *)calloc(ndims, sizeof(hsize_t)),
-    *count = (hsize_t *)calloc(ndims, sizeof(hsize_t)),
-    *start = (hsize_t *)calloc(ndims, sizeof(hsize_t)) ;
-  try {
-    dspace.getSimpleExtentDims(shape) ;
-    if (size < 0 || (size + pos) > shape[0]) size = shape[0] - pos ;
-    points.resize(size) ;
-    start[0] = pos ;
-    if (m_index >= 0) {         // compound dataset
-      if (ndims != 2) throw HDF5::Exception("Compound dataset has wrong shape: " + m_uri) ;
-      count[0] = size ;
-      count[1] = 1 ;
-      start[1] = m_index ;
+// Appends queued after a failed write are discarded until the error is reported.
+void HDF5::AsyncWriter::run(void)
+/*-----------------------------*/
+{
+  while (true) {
+    size_t head = m_head.load(std::memory_order_relaxed) ;
+    if (head == m_tail.load()) {
+      std::unique_lock<std::mutex> lock(m_mutex) ;
+      m_idle = true ;
+      m_ready.wait(lock, [this, head]() { return head != m_tail.load() || m_stopping.load() ; }) ;
+      m_idle = false ;
+      if (head == m_tail.load()) return ;    // Stopping with nothing queued
       }
-    else {                      // simple dataset
-      count[0] = size ;
-      for (int n = 1 ;  n < ndims ;  ++n) {
-        size *= shape[n] ;
-        count[n] = shape[n] ;
-        start[n] = 0 ;
+    Task &task = m_tasks[head & m_mask] ;
+    if (!m_failed.load()) {
+      try {
+        if (task.raw) task.dataset->append(task.data.data(), task.data.size(), task.nsignals) ;
+        else          task.dataset->extend(task.data.data(), task.data.size(), task.nsignals) ;
+        }
+      catch (const HDF5::Exception &e) {
+        fail(e.what()) ;
+        }
+      catch (const H5::Exception &e) {
+        fail("Cannot write dataset: " + e.getDetailMsg()) ;
+        }
+      catch (const std::exception &e) {  // Such as std::bad_alloc, which mustn't end the thread
+        fail(e.what()) ;
         }
       }
-    dspace.selectHyperslab(H5S_SELECT_SET, count, start) ;
-    H5::DataSpace mspace(ndims, count, count) ;
-    m_dataset.read((void *)points.data(), H5::PredType::NATIVE_DOUBLE, mspace, dspace) ;
-    }
-  catch (H5::DataSetIException e) {
-    throw HDF5::Exception("Cannot read dataset '" + m_uri + "': " + e.getDetailMsg()) ;
+    m_head.store(head + 1) ;
+    if (m_waiting.load()) {
+      std::lock_guard<std::mutex> lock(m_mutex) ;
+      m_done.notify_all() ;
+      }
     }
-  free(shape) ;
-  free(count) ;
-  free(start) ;
-
-  return points ;
   }
 
 
 HDF5::File::File(H5::H5File h5file, const std::string &uri)
 /*-------------------------------------------------------*/
-: m_h5file(h5file), m_uri(uri), m_closed(false)
+: m_h5file(h5file), m_uri(uri), m_closed(false), m_deferflush(false)
 {
   }
 
@@ -309,9 +1631,47 @@ const std::string HDF5::File::get_uri(void) const
   return m_uri ;
   }
 
+void HDF5::File::flush(void)
+/*------------------------*/
+{
+  m_h5file.flush(H5F_SCOPE_GLOBAL) ;
+  }
+
+void HDF5::File::start_swmr_write(void)
+/*-----------------------------------*/
+{
+  if (H5Fstart_swmr_write(m_h5file.getId()) < 0)
+    throw HDF5::Exception("Cannot start SWMR writing, the file must be created for SWMR") ;
+  }
+
+void HDF5::File::set_deferred_flush(bool defer)
+/*-------------------------------------------*/
+{
+  m_deferflush = defer ;
+  }
+
+// Make a newly created dataset or stored metadata durable, unless deferred.
+void HDF5::File::flush_updates(void)
+/*--------------------------------*/
+{
+  if (!m_deferflush) m_h5file.flush(H5F_SCOPE_GLOBAL) ;
+  }
+
+
+// File access properties with the raw data chunk cache that datasets use by default.
+// SWMR needs the latest file format.
+static H5::FileAccPropList file_access(const HDF5::ChunkCache &cache, bool latest)
+/*-----------------------------------------------------------------------------*/
+{
+  auto access_properties = H5::FileAccPropList() ;
+  if (cache.bytes > 0) access_properties.setCache(0, cache_slots(cache), cache.bytes, cache.preemption) ;
+  if (latest) access_properties.setLibverBounds(H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) ;
+  return access_properties ;
+  }
 
-HDF5::File *HDF5::File::create(const std::string &uri, const std::string &fname, bool replace)
+HDF5::File *HDF5::File::create(const std::string &uri, const std::string &fname, bool replace,
 /*------------------------------------------------------------------------------------------*/
+                               const HDF5::ChunkCache &cache, bool swmr)
 {
 //Create a new HDF5 Recording file.
 //
@@ -324,9 +1684,8 @@ HDF5::File *HDF5::File::create(const std::string &uri, const std::string &fname,
 #if !H5_DEBUG
     H5::Exception::dontPrint() ;
 #endif
-    auto access_properties = H5::FileAccPropList() ;
     H5::H5File h5file = H5::H5File(fname, replace ? H5F_ACC_TRUNC : H5F_ACC_EXCL,
-      H5::FileCreatPropList::DEFAULT, access_properties) ;
+      H5::FileCreatPropList::DEFAULT, file_access(cache, swmr)) ;
 
     H5::StrType varstr(H5::PredType::C_S1, H5T_VARIABLE) ;
     H5::DataSpace scalar(H5S_SCALAR) ;
@@ -361,8 +1720,9 @@ HDF5::File *HDF5::File::create(const std::string &uri, const std::string &fname,
   }
 
 
-HDF5::File *HDF5::File::open(const std::string &fname, bool readonly)
-/*-----------------------------------------------------------------*/
+HDF5::File *HDF5::File::open(const std::string &fname, bool readonly, const HDF5::ChunkCache &cache,
+/*----------------------------------------------------------------------------------------------*/
+                             bool swmr)
 {
 //Open an existing HDF5 Recording file.
 //
@@ -376,7 +1736,9 @@ HDF5::File *HDF5::File::open(const std::string &fname, bool readonly)
 #endif
   try {
     std::string fn = (!fname.compare(0, 7, "file://")) ? fname.substr(7) : fname ;
-    h5file = H5::H5File(fn, readonly ? H5F_ACC_RDONLY : H5F_ACC_RDWR) ;
+    unsigned int flags = readonly ? H5F_ACC_RDONLY : H5F_ACC_RDWR ;
+    if (swmr) flags |= readonly ? H5F_ACC_SWMR_READ : H5F_ACC_SWMR_WRITE ;
+    h5file = H5::H5File(fn, flags, H5::FileCreatPropList::DEFAULT, file_access(cache, swmr && !readonly)) ;
     }
   catch (H5::FileIException e) {
     throw HDF5::IOError("Cannot open '" + fname + "': " + e.getDetailMsg()) ;
@@ -447,14 +1809,93 @@ HDF5::ClockData::Ptr HDF5::File::check_timing(double rate, const std::string &ur
   }
 
 
+// Add filters to the dataset creation properties to store data as `options` specifies.
+static void set_filters(H5::DSetCreatPropList &props, const HDF5::StorageOptions &options)
+/*--------------------------------------------------------------------------------------*/
+{
+  H5Z_filter_t filter = H5Z_FILTER_NONE ;
+  if      (options.compression == HDF5::BSML_H5_COMPRESS_LZ4)   filter = BSML_H5_FILTER_LZ4 ;
+  else if (options.compression == HDF5::BSML_H5_COMPRESS_ZSTD)  filter = BSML_H5_FILTER_ZSTD ;
+  else if (options.compression == HDF5::BSML_H5_COMPRESS_BLOSC) filter = BSML_H5_FILTER_BLOSC ;
+  if (filter != H5Z_FILTER_NONE && H5Zfilter_avail(filter) <= 0)
+    throw HDF5::Exception("HDF5 filter " + std::to_string(filter) + " is not available") ;
+
+  if (options.shuffle && options.compression != HDF5::BSML_H5_COMPRESS_BLOSC)
+    props.setShuffle() ;      // Blosc shuffles internally
+  switch (options.compression) {
+   case HDF5::BSML_H5_COMPRESS_NONE:
+    break ;
+   case HDF5::BSML_H5_COMPRESS_GZIP:
+    props.setDeflate(options.level >= 0 ? options.level : BSML_H5_DEFAULT_GZIP_LEVEL) ;
+    break ;
+   case HDF5::BSML_H5_COMPRESS_SZIP:
+    props.setSzip(H5_SZIP_NN_OPTION_MASK, 8) ;
+    break ;
+   case HDF5::BSML_H5_COMPRESS_LZ4:
+    props.setFilter(filter, H5Z_FLAG_MANDATORY, 0, nullptr) ;
+    break ;
+   case HDF5::BSML_H5_COMPRESS_ZSTD: {
+    unsigned int level = options.level ;
+    props.setFilter(filter, H5Z_FLAG_MANDATORY, (options.level >= 0) ? 1 : 0, &level) ;
+    break ;
+    }
+   case HDF5::BSML_H5_COMPRESS_BLOSC: {
+    // The first four values are set by the filter, then level, shuffle and compressor
+    unsigned int values[7] = { 0, 0, 0, 0, (options.level >= 0) ? (unsigned int)options.level : 5,
+                               options.shuffle ? 1U : 0U, 0 } ;
+    props.setFilter(filter, H5Z_FLAG_MANDATORY, 7, values) ;
+    break ;
+    }
+    }
+  }
+
+// Set `chunks` to the chunk dimensions for a dataset with `shape` (rows
+// being unlimited), using an explicit shape if given or the layout.
+static void chunk_shape(int rank, const hsize_t *shape, size_t elsize,
+/*------------------------------------------------------------------*/
+                        const HDF5::StorageOptions &options, hsize_t *chunks)
+{
+  if (rank > H5S_MAX_RANK) throw HDF5::Exception("Dataset has too many dimensions") ;
+  if (options.chunk_shape.size() > 0) {
+    if (options.chunk_shape.size() != (size_t)rank)
+      throw HDF5::Exception("Chunk shape doesn't match dataset's dimensions") ;
+    chunks[0] = std::max((hsize_t)1, (hsize_t)options.chunk_shape[0]) ;
+    for (int n = 1 ;  n < rank ;  ++n)
+      chunks[n] = std::max((hsize_t)1, std::min((hsize_t)options.chunk_shape[n], shape[n])) ;
+    return ;
+    }
+  size_t target = (options.chunk_bytes > 0) ? options.chunk_bytes : BSML_H5_CHUNK_BYTES ;
+  size_t rowbytes = elsize ;          // Size of a row, excluding any channel dimension
+  for (int n = 2 ;  n < rank ;  ++n) {
+    chunks[n] = shape[n] ;
+    rowbytes *= shape[n] ;
+    }
+  if (rank > 1) {
+    hsize_t channels = shape[1] ;
+    if (options.layout == HDF5::BSML_H5_CHUNK_CHANNEL)
+      channels = 1 ;
+    else if (options.layout == HDF5::BSML_H5_CHUNK_AUTO    // Split wide rows between chunks
+          && channels*rowbytes*BSML_H5_CHUNK_MIN_ROWS > target)
+      channels = std::max((size_t)1, target/(rowbytes*BSML_H5_CHUNK_MIN_ROWS)) ;
+    chunks[1] = std::max((hsize_t)1, channels) ;
+    rowbytes *= chunks[1] ;
+    }
+  chunks[0] = std::max((size_t)1, target/rowbytes) ;
+  }
+
 HDF5::DatasetRef HDF5::File::create_dataset(const std::string &group,
 /*-----------------------------------------------------------------*/
-                 int rank, hsize_t *shape, hsize_t *maxshape, const double *data)
+                 int rank, hsize_t *shape, hsize_t *maxshape,
+                 const HDF5::StorageOptions &options)
 {
-  H5Compression compression = BSML_H5_DEFAULT_COMPRESSION ;    /*** OPTION ***/
   H5::DataSpace dspace(rank, shape, maxshape) ;
-  H5::DataType dtype = H5::PredType::IEEE_F64LE ;          /*** Create option ?? ***/
-  if (dtype.getId() == 0) dtype = BSML_H5_DEFAULT_DATATYPE ;
+  H5::DataType dtype = BSML_H5_DEFAULT_DATATYPE ;
+  switch (options.datatype) {
+   case BSML_H5_FLOAT32: dtype = H5::PredType::IEEE_F32LE ; break ;
+   case BSML_H5_INT32:   dtype = H5::PredType::STD_I32LE ;  break ;
+   case BSML_H5_INT16:   dtype = H5::PredType::STD_I16LE ;  break ;
+   default:              break ;
+    }
 
   H5::Group grp ;
   try {
@@ -464,32 +1905,20 @@ HDF5::DatasetRef HDF5::File::create_dataset(const std::string &group,
     grp = m_h5file.createGroup("/recording/" + group) ;
     }
   std::string dsetname = "/recording/" + group + "/" + std::to_string(grp.getNumObjs()) ;
-  hsize_t *chunks = (hsize_t *)calloc(rank, sizeof(hsize_t)) ;
+  hsize_t chunks[H5S_MAX_RANK] ;
+  chunk_shape(rank, shape, dtype.getSize(), options, chunks) ;
   H5::DataSet dset ;
   hobj_ref_t reference ;
   try {
     H5::DSetCreatPropList props ;
-    chunks[0] = 4096 ;            /***** MAGIC NUMBER ****/
-    int chunkbytes = chunks[0]*dtype.getSize() ;
-    for (int n = 1 ;  n < rank ;  ++n) {
-      chunkbytes *= shape[n] ;
-      chunks[n] = shape[n] ;
-      }
-    while (chunkbytes < BSML_H5_CHUNK_BYTES) {
-      chunks[0] *= 2 ;
-      chunkbytes *= 2 ;
-      }
     props.setChunk(rank, chunks) ;
-    if      (compression == BSML_H5_COMPRESS_GZIP) props.setDeflate(4) ;
-    else if (compression == BSML_H5_COMPRESS_SZIP) props.setSzip(H5_SZIP_NN_OPTION_MASK, 8) ;
+    set_filters(props, options) ;
     dset = m_h5file.createDataSet(dsetname, dtype, dspace, props) ;
-    if (data != nullptr) dset.write(data, H5::PredType::NATIVE_DOUBLE) ;
     m_h5file.reference(&reference, dsetname) ;
     }
   catch (H5::FileIException e) {
     throw HDF5::Exception("Cannot create '" + group + "' dataset: " + e.getDetailMsg()) ;
     }
-  free(chunks) ;
   return HDF5::DatasetRef(dset, reference) ;
   }
 
@@ -532,10 +1961,113 @@ void HDF5::File::set_signal_attributes(const H5::DataSet &dset, double gain, dou
   }
 
 
+// A pyramid's levels are created with its signal, as datasets
+// can't be created once SWMR writing has started.
+void HDF5::File::create_pyramid(const H5::DataSet &dset, hsize_t columns, const HDF5::StorageOptions &options)
+/*----------------------------------------------------------------------------------------------------------*/
+{
+  if (options.pyramid_factor < 2) throw HDF5::Exception("A pyramid's factor must be at least 2") ;
+  H5::DataSpace scalar(H5S_SCALAR) ;
+  H5::StrType varstr(H5::PredType::C_S1, H5T_VARIABLE) ;
+  try {
+    try {
+      m_h5file.openGroup(BSML_H5_PYRAMID_GROUP) ;
+      }
+    catch (const H5::Exception &e) {
+      m_h5file.createGroup(BSML_H5_PYRAMID_GROUP) ;
+      }
+    std::string signame = dset.getObjName() ;
+    std::string groupname = std::string(BSML_H5_PYRAMID_GROUP) + "/" + signame.substr(signame.rfind('/') + 1) ;
+    H5::Group group = m_h5file.createGroup(groupname) ;
+    uint64_t value = options.pyramid_factor ;
+    H5::Attribute attr = group.createAttribute("factor", H5::PredType::STD_U64LE, scalar) ;
+    attr.write(H5::PredType::NATIVE_UINT64, &value) ;
+    attr.close() ;
+    value = options.pyramid_levels ;
+    attr = group.createAttribute("levels", H5::PredType::STD_U64LE, scalar) ;
+    attr.write(H5::PredType::NATIVE_UINT64, &value) ;
+    attr.close() ;
+
+    hsize_t shape[2] = { 0, 3*columns } ;     // Minimum, maximum and mean of each column
+    hsize_t maxshape[2] = { H5S_UNLIMITED, 3*columns } ;
+    HDF5::StorageOptions leveloptions(options.compression, options.level, options.shuffle) ;
+    hsize_t chunks[2] ;
+    chunk_shape(2, shape, sizeof(double), leveloptions, chunks) ;
+    H5::DSetCreatPropList props ;
+    props.setChunk(2, chunks) ;
+    set_filters(props, leveloptions) ;
+    for (size_t level = 1 ;  level <= options.pyramid_levels ;  ++level) {
+      std::string levelname = groupname + "/" + std::to_string(level) ;
+      H5::DataSet levelset = m_h5file.createDataSet(levelname, H5::PredType::IEEE_F64LE,
+                                                    H5::DataSpace(2, shape, maxshape), props) ;
+      attr = levelset.createAttribute("uri", varstr, scalar) ;
+      attr.write(varstr, levelname) ;
+      attr.close() ;
+      }
+    hobj_ref_t reference ;
+    m_h5file.reference(&reference, groupname) ;
+    attr = dset.createAttribute("pyramid", H5::PredType::STD_REF_OBJ, scalar) ;
+    attr.write(H5::PredType::STD_REF_OBJ, &reference) ;
+    attr.close() ;
+    }
+  catch (const H5::Exception &e) {
+    throw HDF5::Exception("Cannot create pyramid: " + e.getDetailMsg()) ;
+    }
+  }
+
+
+// A chunk summary is created with its signal, with a block of the signal's
+// chunk rows in each of its rows.
+void HDF5::File::create_summary(const H5::DataSet &dset, hsize_t columns, const HDF5::StorageOptions &options)
+/*----------------------------------------------------------------------------------------------------------*/
+{
+  H5::DataSpace scalar(H5S_SCALAR) ;
+  H5::StrType varstr(H5::PredType::C_S1, H5T_VARIABLE) ;
+  try {
+    try {
+      m_h5file.openGroup(BSML_H5_SUMMARY_GROUP) ;
+      }
+    catch (const H5::Exception &e) {
+      m_h5file.createGroup(BSML_H5_SUMMARY_GROUP) ;
+      }
+    std::string signame = dset.getObjName() ;
+    std::string summaryname = std::string(BSML_H5_SUMMARY_GROUP) + "/" + signame.substr(signame.rfind('/') + 1) ;
+    hsize_t shape[2] = { 0, 1 + 4*columns } ;    // Count, then minimum, maximum, sum and sum of squares
+    hsize_t maxshape[2] = { H5S_UNLIMITED, 1 + 4*columns } ;
+    HDF5::StorageOptions summaryoptions(options.compression, options.level, options.shuffle) ;
+    hsize_t chunks[2] ;
+    chunk_shape(2, shape, sizeof(double), summaryoptions, chunks) ;
+    H5::DSetCreatPropList props ;
+    props.setChunk(2, chunks) ;
+    set_filters(props, summaryoptions) ;
+    H5::DataSet summary = m_h5file.createDataSet(summaryname, H5::PredType::IEEE_F64LE,
+                                                 H5::DataSpace(2, shape, maxshape), props) ;
+    H5::Attribute attr = summary.createAttribute("uri", varstr, scalar) ;
+    attr.write(varstr, summaryname) ;
+    attr.close() ;
+    hsize_t sigchunks[H5S_MAX_RANK] ;
+    dset.getCreatePlist().getChunk(H5S_MAX_RANK, sigchunks) ;
+    uint64_t rows = sigchunks[0] ;
+    attr = summary.createAttribute("rows", H5::PredType::STD_U64LE, scalar) ;
+    attr.write(H5::PredType::NATIVE_UINT64, &rows) ;
+    attr.close() ;
+    hobj_ref_t reference ;
+    m_h5file.reference(&reference, summaryname) ;
+    attr = dset.createAttribute("summary", H5::PredType::STD_REF_OBJ, scalar) ;
+    attr.write(H5::PredType::STD_REF_OBJ, &reference) ;
+    attr.close() ;
+    }
+  catch (const H5::Exception &e) {
+    throw HDF5::Exception("Cannot create chunk summary: " + e.getDetailMsg()) ;
+    }
+  }
+
+
 HDF5::SignalData::Ptr HDF5::File::create_signal(const std::string &uri, const std::string &units,
 /*---------------------------------------------------------------------------------------------*/
  const double *data, size_t datasize, std::vector<hsize_t> datashape,
- double gain, double offset, double rate, HDF5::ClockData::Ptr clock)
+ double gain, double offset, double rate, HDF5::ClockData::Ptr clock,
+ const HDF5::StorageOptions &options)
 {
 #if !H5_DEBUG
   H5::Exception::dontPrint() ;
@@ -548,26 +2080,20 @@ HDF5::SignalData::Ptr HDF5::File::create_signal(const std::string &uri, const st
     throw HDF5::Exception("Signal's URI '" + uri + "' already specified") ;
     }
   catch (H5::AttributeIException e) { }
+  if (gain == 0.0) throw HDF5::Exception("Signal's gain cannot be zero") ;
 
-  size_t npoints = 0 ;
   int rank = datashape.size() + 1 ;
   hsize_t *shape = (hsize_t *)calloc(rank, sizeof(hsize_t)) ;
   hsize_t *maxshape = (hsize_t *)calloc(rank, sizeof(hsize_t)) ;
   maxshape[0] = H5S_UNLIMITED ;
-  int elsize = 1 ;
   if (rank > 1) {           // simple dataset, shape of data point given
     for (int n = 0 ;  n < (rank - 1) ;  ++n) {
       int count = datashape.at(n) ;
       maxshape[n + 1] = shape[n + 1] = count ;
-      elsize *= count ;
       }
-    npoints = (data != nullptr) ? datasize/elsize : 0 ;
     }
-  else if (data != nullptr) {  // simple dataset, data determines shape
-    npoints = datasize ;
-    }
-  shape[0] = npoints ;
-  HDF5::DatasetRef sigdata = create_dataset("signal", rank, shape, maxshape, data) ;
+  shape[0] = 0 ;            // Any data is added once gain and offset are set
+  HDF5::DatasetRef sigdata = create_dataset("signal", rank, shape, maxshape, options) ;
   free(maxshape) ;
   free(shape) ;
   H5::DataSet dset = sigdata.first ;
@@ -594,26 +2120,36 @@ HDF5::SignalData::Ptr HDF5::File::create_signal(const std::string &uri, const st
   catch (H5::AttributeIException e) {
     throw HDF5::Exception("Cannot set signal's attributes: " + e.getDetailMsg()) ;
     }
-
-  m_h5file.flush(H5F_SCOPE_GLOBAL) ;
-  return std::make_shared<HDF5::SignalData>(uri, sigdata) ;
+  hsize_t columns = 1 ;
+  for (auto const &n : datashape) columns *= n ;
+  if (options.pyramid_levels > 0) create_pyramid(dset, columns, options) ;
+  if (options.chunk_summaries) create_summary(dset, columns, options) ;
+
+  flush_updates() ;
+  auto signal = std::make_shared<HDF5::SignalData>(uri, sigdata) ;
+  signal->set_clock(clock) ;
+  if (data != nullptr && datasize > 0) signal->extend(data, datasize, 1) ;
+  return signal ;
   }
 
 
 HDF5::SignalData::Ptr HDF5::File::create_signal(const std::vector<std::string> &uris,
 /*---------------------------------------------------------------------------------*/
  const std::vector<std::string> &units, const double *data, size_t datasize,
- double gain, double offset, double rate, HDF5::ClockData::Ptr clock)
+ double gain, double offset, double rate, HDF5::ClockData::Ptr clock,
+ const HDF5::StorageOptions &options)
 {
 #if !H5_DEBUG
   H5::Exception::dontPrint() ;
 #endif
   if (uris.size() != units.size()) throw HDF5::Exception("'uri' and 'units' have different sizes") ;
+  if (gain == 0.0) throw HDF5::Exception("Signal's gain cannot be zero") ;
   int nsignals = uris.size() ;
 
   if (nsignals == 1) {
     return
-      create_signal(uris[0], units[0], data, datasize, std::vector<hsize_t>(), gain, offset, rate, clock) ;
+      create_signal(uris[0], units[0], data, datasize, std::vector<hsize_t>(),
+                    gain, offset, rate, clock, options) ;
     }
   H5::Attribute attr ;
   H5::Group urigroup = m_h5file.openGroup("/uris") ;
@@ -627,11 +2163,10 @@ HDF5::SignalData::Ptr HDF5::File::create_signal(const std::vector<std::string> &
       }
     catch (H5::AttributeIException e) { }
     }
-  size_t npoints = (data != nullptr) ? datasize/nsignals : 0 ;
   hsize_t maxshape[2] = { H5S_UNLIMITED, (hsize_t)nsignals } ;
-  hsize_t shape[2]    = { npoints,       (hsize_t)nsignals } ;
+  hsize_t shape[2]    = { 0,             (hsize_t)nsignals } ;   // Data is added below
 
-  HDF5::DatasetRef sigdata = create_dataset("signal", 2, shape, maxshape, data) ;
+  HDF5::DatasetRef sigdata = create_dataset("signal", 2, shape, maxshape, options) ;
   H5::DataSet dset = sigdata.first ;
 
   H5::DataSpace scalar(H5S_SCALAR) ;
@@ -669,15 +2204,21 @@ HDF5::SignalData::Ptr HDF5::File::create_signal(const std::vector<std::string> &
   for (n = 0 ;  n < nsignals ;  ++n)
     if (values[n]) free((void *)values[n]) ;
   free(values) ;
+  if (options.pyramid_levels > 0) create_pyramid(dset, nsignals, options) ;
+  if (options.chunk_summaries) create_summary(dset, nsignals, options) ;
 
-  m_h5file.flush(H5F_SCOPE_GLOBAL) ;
-  return std::make_shared<HDF5::SignalData>("", sigdata) ;
+  flush_updates() ;
+  auto signals = std::make_shared<HDF5::SignalData>("", sigdata) ;
+  signals->set_clock(clock) ;
+  if (data != nullptr && datasize > 0) signals->extend(data, datasize, nsignals) ;
+  return signals ;
   }
 
 
 HDF5::ClockData::Ptr HDF5::File::create_clock(const std::string &uri, const std::string &units,
 /*-------------------------------------------------------------------------------------------*/
-                                          double rate, const double *data, size_t datasize)
+                                          double rate, const double *data, size_t datasize,
+                                          const HDF5::StorageOptions &options)
 {
 #if !H5_DEBUG
   H5::Exception::dontPrint() ;
@@ -695,8 +2236,8 @@ HDF5::ClockData::Ptr HDF5::File::create_clock(const std::string &uri, const std:
     throw HDF5::Exception("A Clock cannot have both 'times' and a 'rate'") ;
 
   hsize_t maxshape[] = { H5S_UNLIMITED } ;
-  hsize_t shape[]    = { datasize } ;
-  HDF5::DatasetRef clkdata = create_dataset("clock", 1, shape, maxshape, data) ;
+  hsize_t shape[]    = { 0 } ;     // Times are added below, so they are indexed
+  HDF5::DatasetRef clkdata = create_dataset("clock", 1, shape, maxshape, options) ;
   H5::DataSet dset = clkdata.first ;
 
   H5::DataSpace scalar(H5S_SCALAR) ;
@@ -723,15 +2264,18 @@ HDF5::ClockData::Ptr HDF5::File::create_clock(const std::string &uri, const std:
     throw HDF5::Exception("Cannot set clock's attributes: " + e.getDetailMsg()) ;
     }
 
-  m_h5file.flush(H5F_SCOPE_GLOBAL) ;
-  return std::make_shared<HDF5::ClockData>(uri, clkdata) ;
+  flush_updates() ;
+  auto clock = std::make_shared<HDF5::ClockData>(uri, clkdata) ;
+  if (data != nullptr && datasize > 0) clock->extend(data, datasize, 1) ;
+  return clock ;
   }
 
 HDF5::ClockData::Ptr HDF5::File::create_clock(const std::string &uri, const std::string &units,
 /*-------------------------------------------------------------------------------------------*/
-                                          const double *data, size_t datasize)
+                                          const double *data, size_t datasize,
+                                          const HDF5::StorageOptions &options)
 {
-  return create_clock(uri, units, 0.0, data, datasize) ;
+  return create_clock(uri, units, 0.0, data, datasize, options) ;
   }
 
 
@@ -908,7 +2452,7 @@ void HDF5::File::store_metadata(const std::string &metadata, const std::string &
   H5::Attribute attr = md.createAttribute("mimetype", varstr, scalar) ;
   attr.write(varstr, mimetype) ;
   md.close() ;
-  m_h5file.flush(H5F_SCOPE_GLOBAL) ;
+  flush_updates() ;
   }
 
 
@@ -936,90 +2480,259 @@ std::pair<std::string, std::string> HDF5::File::get_metadata(void)
   }
 
 
-HDF5::IndexCache::IndexCache(const HDF5::ClockData *clock, const bool right)
-/*------------------------------------------------------------------------*/
-: m_clock(clock), m_right(right),
-  m_indexes(std::vector<ssize_t>()), m_times(std::vector<double>())
+HDF5::TimeIndex::TimeIndex(HDF5::ClockData *clock, size_t maxbytes)
+/*----------------------------------------------------------------*/
+: m_clock(clock), m_maxsamples(0), m_stride(0), m_modified(false), m_saved(0)
 {
+  set_size(maxbytes) ;
   }
 
-void HDF5::IndexCache::insert(const size_t pos, const double t, const ssize_t index)
-/*--------------------------------------------------------------------------------*/
+void HDF5::TimeIndex::set_size(size_t maxbytes)
+/*-------------------------------------------*/
 {
-  m_times.insert(m_times.begin() + pos, t) ;
-  m_indexes.insert(m_indexes.begin() + pos, index) ;
+  m_maxsamples = std::max((size_t)1, maxbytes/sizeof(double)) ;
   }
 
-// Search `clock` for the index with time `t` and if not an exact match
-// return the index to the immediate left (or right if `right` set). Return
-// `-1` (`clock->size()`) if none to the left (right).
-ssize_t HDF5::IndexCache::search(size_t start, size_t end, const double t) const
-/*----------------------------------------------------------------------------*/
+void HDF5::TimeIndex::resize(size_t size)
+/*-------------------------------------*/
+{
+  if (m_stride == 0) {      // Sample the first time in each of the clock's chunks
+    m_stride = m_clock->chunk_rows() ;
+    if (m_stride == 0) m_stride = BSML_H5_CHUNK_BYTES/sizeof(double) ;
+    }
+  size_t count = (size + m_stride - 1)/m_stride ;
+  while (count > m_maxsamples) {  // Halve the resolution, keeping every other sample
+    for (size_t n = 0 ;  2*n < m_samples.size() ;  ++n) m_samples[n] = m_samples[2*n] ;
+    m_samples.resize((m_samples.size() + 1)/2) ;
+    m_stride *= 2 ;
+    m_saved = 0 ;                 // Every sample has moved
+    count = (size + m_stride - 1)/m_stride ;
+    }
+  m_samples.resize(count, NAN) ;
+  }
+
+void HDF5::TimeIndex::add(size_t pos, const double *times, size_t count)
+/*--------------------------------------------------------------------*/
+{
+  resize(pos + count) ;
+  for (size_t n = (pos + m_stride - 1)/m_stride ;  n*m_stride < pos + count ;  ++n) {
+    m_samples[n] = times[n*m_stride - pos] ;
+    m_saved = std::min(m_saved, n) ;
+    m_modified = true ;
+    }
+  }
+
+void HDF5::TimeIndex::fill(void)
+/*----------------------------*/
+{
+  resize(m_clock->size()) ;
+  for (size_t n = 0 ;  n < m_samples.size() ;  ++n) {
+    if (std::isnan(m_samples[n])) {
+      sample(n) ;
+      m_saved = std::min(m_saved, n) ;
+      m_modified = true ;
+      }
+    }
+  }
+
+void HDF5::TimeIndex::load(size_t stride, std::vector<double> &&samples)
+/*--------------------------------------------------------------------*/
+{
+  if (stride == 0) return ;
+  m_stride = stride ;
+  m_samples = std::move(samples) ;
+  size_t size = m_clock->size() ;   // Ignore samples past the end of the clock
+  size_t count = (size + m_stride - 1)/m_stride ;
+  if (m_samples.size() > count) m_samples.resize(count) ;
+  m_saved = m_samples.size() ;
+  resize(size) ;
+  m_modified = false ;
+  }
+
+size_t HDF5::TimeIndex::stride(void) const
+/*--------------------------------------*/
+{
+  return m_stride ;
+  }
+
+const std::vector<double> &HDF5::TimeIndex::samples(void) const
+/*-----------------------------------------------------------*/
+{
+  return m_samples ;
+  }
+
+bool HDF5::TimeIndex::modified(void) const
+/*--------------------------------------*/
+{
+  return m_modified ;
+  }
+
+size_t HDF5::TimeIndex::saved(void) const
+/*-------------------------------------*/
+{
+  return std::min(m_saved, m_samples.size()) ;
+  }
+
+void HDF5::TimeIndex::set_saved(size_t saved)
+/*-----------------------------------------*/
+{
+  m_saved = saved ;
+  }
+
+void HDF5::TimeIndex::set_modified(bool modified)
+/*---------------------------------------------*/
+{
+  m_modified = modified ;
+  }
+
+double HDF5::TimeIndex::sample(size_t n)
+/*------------------------------------*/
+{
+  if (std::isnan(m_samples[n])) m_samples[n] = m_clock->read_time(n*m_stride) ;
+  return m_samples[n] ;
+  }
+
+size_t HDF5::TimeIndex::search(const double t, const bool upper, size_t from)
+/*-------------------------------------------------------------------------*/
+{
+  const size_t size = m_clock->size() ;
+  if (from >= size) return size ;
+  resize(size) ;
+
+  // Find the first sample that isn't before `t`, then
+  // search the clock between it and the preceding sample.
+  size_t lo = from/m_stride + 1, hi = m_samples.size() ;
+  while (lo < hi) {
+    size_t mid = (lo + hi)/2 ;
+    double tmid = sample(mid) ;
+    if (upper ? (tmid <= t) : (tmid < t)) lo = mid + 1 ;
+    else                                  hi = mid ;
+    }
+  hi = std::min(lo*m_stride, size) ;
+  lo = std::max(from, (lo - 1)*m_stride) ;
+  while (lo < hi) {
+    size_t mid = (lo + hi)/2 ;
+    double tmid = m_clock->read_time(mid) ;
+    if (upper ? (tmid <= t) : (tmid < t)) lo = mid + 1 ;
+    else                                  hi = mid ;
+    }
+  return lo ;
+  }
+
+
+HDF5::ChunkCounter::ChunkCounter()
+/*------------------------------*/
+: m_capacity(0)
+{
+  }
+
+void HDF5::ChunkCounter::set_capacity(size_t chunks)
+/*------------------------------------------------*/
 {
-  // `t` is after `time(start)` and before `time(end)`
-  // Want largest index such that `t <= time(index)`
-  while (start < end) {
-    auto mid = (start + end)/2 ;
-    auto tmid = m_clock->read_time(mid) ;
-    if (t == tmid) return mid ;
-    else if (t < tmid) end = mid ;
-    else start = mid + 1 ;
-    }
-  return m_right ? end : (end - 1) ;  // start - 1 ??
-  }
-
-// LEFT:
-//  Find largest `n` such that `time(n) <= t`.
-//  Return `-1` if `n` doesn't exist.
-// RIGHT:
-//  Find smallest `n` such that `t <= time(n)`.
-//  Return `size()` if `n` doesn't exist.
-ssize_t HDF5::IndexCache::find(const double t)
+  m_capacity = chunks ;
+  m_chunks.clear() ;
+  m_index.clear() ;
+  m_statistics = HDF5::CacheStatistics() ;
+  }
+
+void HDF5::ChunkCounter::access(hsize_t chunk)
 /*------------------------------------------*/
 {
-  ssize_t index ;
+  auto found = m_index.find(chunk) ;
+  if (found != m_index.end()) {
+    m_chunks.splice(m_chunks.begin(), m_chunks, found->second) ;
+    ++m_statistics.hits ;
+    return ;
+    }
+  ++m_statistics.misses ;
+  if (m_capacity == 0) return ;     // Chunks larger than the cache aren't cached
+  if (m_chunks.size() >= m_capacity) {
+    m_index.erase(m_chunks.back()) ;
+    m_chunks.pop_back() ;
+    }
+  m_chunks.push_front(chunk) ;
+  m_index[chunk] = m_chunks.begin() ;
+  }
+
+HDF5::CacheStatistics HDF5::ChunkCounter::statistics(void) const
+/*------------------------------------------------------------*/
+{
+  return m_statistics ;
+  }
+
+
+HDF5::BlockCache::BlockCache(HDF5::Dataset *dataset, size_t maxbytes)
+/*------------------------------------------------------------------*/
+: m_dataset(dataset), m_maxbytes(maxbytes), m_blocksize(0), m_maxblocks(0)
+{
+  }
+
+void HDF5::BlockCache::set_size(size_t maxbytes)
+/*--------------------------------------------*/
+{
+  m_maxbytes = maxbytes ;
+  clear() ;
+  }
 
-  if (m_times.size() == 0) {
-    index = this->search(0, m_clock->size(), t) ;
-    this->insert(0, t, index) ;
+void HDF5::BlockCache::clear(void)
+/*------------------------------*/
+{
+  m_blocks.clear() ;
+  m_index.clear() ;
+  m_blocksize = 0 ;
+  }
+
+double HDF5::BlockCache::get(const size_t pos)
+/*------------------------------------------*/
+{
+  if (m_blocksize == 0) {   // Use the dataset's chunking, so a block is decompressed once
+    m_blocksize = m_dataset->chunk_rows() ;
+    if (m_blocksize == 0) m_blocksize = BSML_H5_CHUNK_BYTES/sizeof(double) ;
+    m_maxblocks = std::max((size_t)1, m_maxbytes/(m_blocksize*sizeof(double))) ;
     }
-  else {
-    // Get iterator to first item greater than or equal to `t` in cache.
-    auto lb = std::lower_bound(m_times.begin(), m_times.end(), t) ;
-    size_t n = std::distance(m_times.begin(), lb) ;
+  size_t number = pos/m_blocksize ;
+  size_t offset = pos % m_blocksize ;
 
-    if (lb == m_times.end()) {                  // After last item in cache
-      // index is after `m_indexes[n-1]` and before this->size()
-      index = this->search(m_indexes[n-1], m_clock->size(), t) ;
-      }
-    else if (t == *lb) {                        // Match
-      return m_indexes[n] ;
-      }
-    else if (n == 0) {                          // Before first item in cache
-      index = this->search(0, m_indexes[0], t) ;
-      }
-    else if (m_indexes[n-1] == m_indexes[n]) {  // Overlap
-      return m_indexes[n] ;
-      }
-    else {                                      // Between `m_indexes[n-1]` and `m_indexes[n]`
-      index = this->search(m_indexes[n-1], m_indexes[n], t) ;
+  if (m_blocks.size() > 0 && m_blocks.front().first == number
+   && offset < m_blocks.front().second.size())
+    return m_blocks.front().second[offset] ;
+
+  auto found = m_index.find(number) ;
+  if (found != m_index.end()) {
+    m_blocks.splice(m_blocks.begin(), m_blocks, found->second) ;
+    }
+  else {
+    if (m_blocks.size() >= m_maxblocks) {
+      m_index.erase(m_blocks.back().first) ;
+      m_blocks.pop_back() ;
       }
-    this->insert(n, t, index) ;
+    m_blocks.emplace_front(number, std::vector<double>()) ;
+    m_index[number] = m_blocks.begin() ;
+    }
+  std::vector<double> &block = m_blocks.front().second ;
+  if (offset >= block.size()) {   // New, or the last block and the dataset has grown
+    block.resize(m_blocksize) ;
+    block.resize(m_dataset->read(number*m_blocksize, m_blocksize, block.data())) ;
+    if (offset >= block.size())
+      throw HDF5::Exception("Position past end of '" + m_dataset->name() + "'") ;
     }
-  return index ;
+  return block[offset] ;
   }
 
 
 HDF5::ClockData::ClockData()
 /*------------------------*/
-: HDF5::Dataset(), m_leftcache(this, false), m_rightcache(this, true)
+: HDF5::Dataset(), m_blockcache(this, BSML_H5_CLOCK_CACHE_BYTES),
+  m_timeindex(this, BSML_H5_CLOCK_INDEX_BYTES)
 {
   }
 
 HDF5::ClockData::ClockData(const std::string &uri, const HDF5::DatasetRef &ds)
 /*--------------------------------------------------------------------------*/
-: HDF5::Dataset(uri, ds), m_leftcache(this, false), m_rightcache(this, true)
+: HDF5::Dataset(uri, ds), m_blockcache(this, BSML_H5_CLOCK_CACHE_BYTES),
+  m_timeindex(this, BSML_H5_CLOCK_INDEX_BYTES)
 {
+  load_index() ;
   }
 
 HDF5::ClockData::Ptr HDF5::ClockData::get_clock(const std::string &uri, const HDF5::DatasetRef &dataref)
@@ -1049,37 +2762,191 @@ HDF5::ClockData::Ptr HDF5::ClockData::get_clock(const std::string &uri, const HD
   return std::make_shared<HDF5::ClockData>(uri, dataref) ;
   }
 
-double HDF5::ClockData::read_time(size_t pos) const
-/*-----------------------------------------------*/
+double HDF5::ClockData::read_time(size_t pos)
+/*-----------------------------------------*/
+{
+  flush() ;
+  if (m_shape[0] == 0) throw HDF5::Exception("Clock '" + m_uri + "' has no times") ;
+  if (pos >= m_shape[0]) pos = m_shape[0] - 1 ;  // reading past end...
+  return m_blockcache.get(pos) ;
+  }
+
+void HDF5::ClockData::set_cache_size(size_t maxbytes)
+/*-------------------------------------------------*/
+{
+  wait() ;
+  m_blockcache.set_size(maxbytes) ;
+  }
+
+void HDF5::ClockData::set_index_size(size_t maxbytes)
+/*-------------------------------------------------*/
+{
+  wait() ;
+  m_timeindex.set_size(maxbytes) ;
+  }
+
+
+void HDF5::ClockData::extend(const double *data, ssize_t length, int nsignals)
+/*--------------------------------------------------------------------------*/
+{
+  if (queue(data, length, nsignals, false)) return ;
+  size_t pos = size() ;
+  HDF5::Dataset::extend(data, length, nsignals) ;
+  m_timeindex.add(pos, data, length) ;   // Saved by `save_index()` on flush or close
+  }
+
+void HDF5::ClockData::close(void)
+/*-----------------------------*/
+{
+  wait() ;
+  if (m_dataset.getId() >= 0) save_index() ;
+  HDF5::Dataset::close() ;
+  }
+
+
+// The index is kept in its own dataset, referenced from the clock's
+// `index` attribute, with the clock positions between samples in the
+// index's `stride` attribute. Clocks without an index are searched
+// directly, sampling times as they are needed.
+void HDF5::ClockData::load_index(void)
+/*----------------------------------*/
 {
-  H5::DataSpace dspace = m_dataset.getSpace() ;
-  hsize_t shape[1], count[1], start[1] ;
   try {
-    double times[1] ;
-    dspace.getSimpleExtentDims(shape) ;
-    if (pos >= shape[0]) pos = shape[0] ;  // reading past end...
-    start[0] = pos ;
-    count[0] = 1 ;
-    dspace.selectHyperslab(H5S_SELECT_SET, count, start) ;
-    H5::DataSpace mspace(1, count, count) ;
-    m_dataset.read((void *)times, H5::PredType::NATIVE_DOUBLE, mspace, dspace) ;
-    return times[0] ;
+    H5::Attribute attr = m_dataset.openAttribute("index") ;
+    hobj_ref_t ref ;
+    attr.read(H5::PredType::STD_REF_OBJ, &ref) ;
+    attr.close() ;
+    H5::DataSet index = H5::DataSet(m_dataset, &ref) ;
+    uint64_t stride = 0 ;
+    attr = index.openAttribute("stride") ;
+    attr.read(H5::PredType::NATIVE_UINT64, &stride) ;
+    attr.close() ;
+    std::vector<double> samples(index.getSpace().getSimpleExtentNpoints()) ;
+    if (samples.size() > 0) index.read(samples.data(), H5::PredType::NATIVE_DOUBLE) ;
+    m_timeindex.load(stride, std::move(samples)) ;
     }
-  catch (H5::DataSetIException e) {
-    throw HDF5::Exception("Cannot read Clock '" + m_uri + "': " + e.getDetailMsg()) ;
+  catch (const H5::Exception &e) { }   // No (or an unreadable) index
+  }
+
+void HDF5::ClockData::save_index(void)
+/*----------------------------------*/
+{
+  if (!m_timeindex.modified()) return ;
+  const std::vector<double> &samples = m_timeindex.samples() ;
+  hsize_t count = samples.size() ;
+  hsize_t first = m_timeindex.saved() ;   // Samples before `first` are already on file
+  H5::DataSet index ;
+  H5::Attribute attr ;
+  H5::DataSpace scalar(H5S_SCALAR) ;
+  try {
+    try {
+      attr = m_dataset.openAttribute("index") ;
+      hobj_ref_t ref ;
+      attr.read(H5::PredType::STD_REF_OBJ, &ref) ;
+      attr.close() ;
+      index = H5::DataSet(m_dataset, &ref) ;
+      }
+    catch (const H5::AttributeIException &e) {
+      H5::Group grp ;
+      try {
+        grp = m_dataset.openGroup(BSML_H5_CLOCK_INDEX_GROUP) ;
+        }
+      catch (const H5::Exception &e) {
+        grp = m_dataset.createGroup(BSML_H5_CLOCK_INDEX_GROUP) ;
+        }
+      std::string clockname = name() ;
+      std::string indexname = clockname.substr(clockname.rfind('/') + 1) ;
+      first = 0 ;
+      try {
+        index = grp.openDataSet(indexname) ;   // Rebuilding an unlinked index
+        }
+      catch (const H5::Exception &e) {
+        hsize_t maxshape[] = { H5S_UNLIMITED } ;
+        hsize_t chunks[] = { 1024 } ;
+        H5::DSetCreatPropList props ;
+        props.setChunk(1, chunks) ;
+        index = grp.createDataSet(indexname, H5::PredType::IEEE_F64LE,
+                                  H5::DataSpace(1, &count, maxshape), props) ;
+        attr = index.createAttribute("stride", H5::PredType::STD_U64LE, scalar) ;
+        attr.close() ;
+        }
+      hobj_ref_t ref ;
+      grp.reference(&ref, indexname) ;
+      attr = m_dataset.createAttribute("index", H5::PredType::STD_REF_OBJ, scalar) ;
+      attr.write(H5::PredType::STD_REF_OBJ, &ref) ;
+      attr.close() ;
+      }
+    index.extend(&count) ;
+    if (count > first) {
+      hsize_t length = count - first ;
+      H5::DataSpace dspace(1, &count) ;
+      dspace.selectHyperslab(H5S_SELECT_SET, &length, &first) ;
+      H5::DataSpace mspace(1, &length) ;
+      index.write(samples.data() + first, H5::PredType::NATIVE_DOUBLE, mspace, dspace) ;
+      }
+    if (first == 0) {               // The stride only changes when all samples do
+      uint64_t stride = m_timeindex.stride() ;
+      attr = index.openAttribute("stride") ;
+      attr.write(H5::PredType::NATIVE_UINT64, &stride) ;
+      attr.close() ;
+      }
+    }
+  catch (const H5::Exception &e) {
+    throw HDF5::Exception("Cannot save time index for '" + m_uri + "': " + e.getDetailMsg()) ;
     }
+  m_timeindex.set_saved(count) ;
+  m_timeindex.set_modified(false) ;
+  }
+
+void HDF5::ClockData::create_index(void)
+/*------------------------------------*/
+{
+  wait() ;
+  m_timeindex.set_modified(true) ;
+  save_index() ;
+  }
+
+// A clock being written by another process may have times past `t`
+// that we haven't yet seen.
+void HDF5::ClockData::refresh_after(const double t)
+/*-----------------------------------------------*/
+{
+  if (m_live && (m_shape[0] == 0 || read_time(m_shape[0] - 1) <= t)) refresh() ;
+  }
+
+void HDF5::ClockData::rebuild_index(void)
+/*-------------------------------------*/
+{
+  wait() ;
+  m_timeindex.fill() ;
+  m_timeindex.set_modified(true) ;
+  m_timeindex.set_saved(0) ;
+  save_index() ;
   }
 
 ssize_t HDF5::ClockData::index(const double t)
 /*-----------------------------------------*/
 {
-  return m_leftcache.find(t) ;
+  wait() ;
+  refresh_after(t) ;
+  return (ssize_t)m_timeindex.search(t, true) - 1 ;
   }
 
 size_t HDF5::ClockData::index_right(const double t)
 /*-----------------------------------------------*/
 {
-  return m_rightcache.find(t) ;
+  wait() ;
+  refresh_after(t) ;
+  return m_timeindex.search(t, false) ;
+  }
+
+std::pair<size_t, ssize_t> HDF5::ClockData::index_range(const double start, const double end)
+/*-----------------------------------------------------------------------------------------*/
+{
+  wait() ;
+  refresh_after(end) ;
+  size_t first = m_timeindex.search(start, false) ;
+  return std::make_pair(first, (ssize_t)m_timeindex.search(end, true, first) - 1) ;
   }
 
 
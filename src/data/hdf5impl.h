@@ -22,11 +22,20 @@
 #define BSML_HDF5IMPL_H
 
 #include <biosignalml/biosignalml_export.h>
+#include <biosignalml/data/hdf5.h>
 
 #include <H5Cpp.h>
 
 #include <list>
 #include <vector>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 
 namespace bsml {
@@ -34,8 +43,21 @@ namespace bsml {
   namespace HDF5 {
 
 #define BSML_H5_DEFAULT_DATATYPE    H5::PredType::IEEE_F64LE
-#define BSML_H5_DEFAULT_COMPRESSION BSML_H5_COMPRESS_GZIP
+#define BSML_H5_DEFAULT_GZIP_LEVEL  4
+
+#define BSML_H5_FILTER_BLOSC        32001   // Registered third-party filters
+#define BSML_H5_FILTER_LZ4          32004
+#define BSML_H5_FILTER_ZSTD         32015
 #define BSML_H5_CHUNK_BYTES         (128*1024)
+#define BSML_H5_CHUNK_MIN_ROWS      1024
+#define BSML_H5_CLOCK_CACHE_BYTES   (4*1024*1024)
+#define BSML_H5_CLOCK_INDEX_BYTES   (1024*1024)
+#define BSML_H5_CLOCK_INDEX_GROUP   "/recording/clock_index"
+#define BSML_H5_PYRAMID_GROUP       "/recording/pyramid"
+#define BSML_H5_SUMMARY_GROUP       "/recording/summary"
+#define BSML_H5_ASYNC_QUEUE_LENGTH  256     // Default appends queued for a writer thread
+#define BSML_H5_POLL_MILLISECONDS   1       // Interval between polls of a cursor waiting for points
+#define BSML_H5_SELECT_VALUES       (1024*1024)   // Values held when selecting a percentile
 
 
     class DatasetRef : public std::pair<H5::DataSet, hobj_ref_t>
@@ -50,6 +72,43 @@ namespace bsml {
       } ;
 
 
+    //! HDF5 doesn't report how its chunk cache performs, so estimate hits
+    //! and misses by following chunk reads through an LRU cache model. The
+    //! model holds `bytes/chunk size` whole chunks and doesn't simulate the
+    //! cache's hash slots, `w0` preemption or chunks cached by writes.
+    class ChunkCounter
+    /*--------------*/
+    {
+     public:
+      ChunkCounter() ;
+
+      //! Set the number of chunks the cache can hold.
+      void set_capacity(size_t chunks) ;
+      void access(hsize_t chunk) ;
+      CacheStatistics statistics(void) const ;
+
+     private:
+      size_t m_capacity ;
+      std::list<hsize_t> m_chunks ;   // Most recently used first
+      std::unordered_map<hsize_t, std::list<hsize_t>::iterator> m_index ;
+      CacheStatistics m_statistics ;
+      } ;
+
+
+    //! The minimum, maximum and mean of successive points of a signal.
+    struct Bin
+    {
+      size_t start ;          // Position of the first point
+      size_t count ;
+      double min ;
+      double max ;
+      double mean ;
+      } ;
+
+    class Pyramid ;   // Declare forward
+    class ChunkSummary ;
+
+
     class BIOSIGNALML_EXPORT Dataset
     /*----------------------------*/
     {
@@ -57,49 +116,351 @@ namespace bsml {
 
       Dataset() ;
       Dataset(const std::string &uri, const DatasetRef &dataref) ;
+      //! Buffered data is written when a dataset is destroyed, but as errors
+      //! can't then be thrown they are passed to any error handler.
       virtual ~Dataset() ;
 
-      void close(void) ;
+      //! Write any buffered data and close the dataset, throwing on a write error.
+      virtual void close(void) ;
       H5::DataSet get_dataset(void) const ;
       hobj_ref_t get_reference(void) const ;
       size_t size(void) const ;
       std::string name(void) const ;
-      void extend(const double *data, ssize_t length, int nsignals) ;
+      //! Append physical values, stored as the dataset's type after
+      //! removing any gain and offset. Values are rounded and clamped to an
+      //! integer type's range, and a NaN can't be stored in one so throws.
+      virtual void extend(const double *data, ssize_t length, int nsignals) ;
+      //! Append raw values, stored without scaling.
+      void extend(const int16_t *data, ssize_t length, int nsignals) ;
+      void extend(const int32_t *data, ssize_t length, int nsignals) ;
+      //! Append `rows` points from each of a compound dataset's columns,
+      //! given as one buffer per column.
+      void extend(const double *const *planes, size_t rows) ;
       std::vector<double> read(size_t pos, ssize_t length) ;
+      //! Read up to `length` points into `buffer`, returning the number read.
+      size_t read(size_t pos, size_t length, double *buffer) ;
+      //! Read up to `length` rows of a compound dataset into one buffer per
+      //! column, returning the number of rows read.
+      size_t read(size_t pos, size_t length, double *const *planes) ;
+      //! Read up to `length` raw values from an integer dataset.
+      size_t read(size_t pos, size_t length, int16_t *buffer) ;
+      size_t read(size_t pos, size_t length, int32_t *buffer) ;
+      //! Read rows of several columns of a compound dataset with a single selection,
+      //! returning each row's values for the (ascending) `columns` in turn.
+      std::vector<double> read_columns(const std::vector<hsize_t> &columns, size_t pos, ssize_t length) ;
+      //! The column of a compound dataset holding the signal, or -1 if the
+      //! dataset is not compound.
+      int column(void) const ;
+      //! Make this signal a view of one column of `parent`, the compound
+      //! dataset's own Dataset, which may hold buffered points.
+      void set_parent(std::shared_ptr<Dataset> parent) ;
+
+      //! Queue appends for `writer`'s thread instead of writing them directly,
+      //! or write directly again if `writer` is null.
+      void set_writer(std::shared_ptr<AsyncWriter> writer) ;
+      //! Pass errors closing the dataset as it's destroyed to `handler`.
+      void set_error_handler(const ErrorHandler &handler) ;
+
+      //! Coalesce appended data in a buffer of at least `size` samples (or bytes),
+      //! rounded up to a whole number of chunks. A `size` of zero disables buffering.
+      void set_buffer_size(size_t size, H5BufferUnits units=BSML_H5_BUFFER_SAMPLES) ;
+      //! Write any buffered data to the dataset.
+      void flush(void) ;
+      //! Set the clock that timestamps the dataset's points.
+      void set_clock(std::shared_ptr<ClockData> clock) ;
+      //! Re-read the dataset's extent from file.
+      void refresh(void) ;
+      //! The dataset is being written by another process, so refresh
+      //! its extent when reading past the end.
+      void set_live(bool live) ;
+      //! Refresh the dataset's extent and read every point from `pos` to its end.
+      std::vector<double> read_tail(size_t pos) ;
+      //! Summarise up to `length` points from `pos` in at most `maxbins` bins.
+      std::vector<Bin> envelope(size_t pos, ssize_t length, size_t maxbins) ;
+      //! Summarise `columns` of a compound dataset the same way, with the
+      //! same bins for each column.
+      std::vector<std::vector<Bin>> envelope(const std::vector<hsize_t> &columns,
+                                             size_t pos, ssize_t length, size_t maxbins) ;
+      //! Whether the dataset keeps a pyramid of summaries of its points.
+      bool has_pyramid(void) const ;
+      //! Statistics of up to `length` points from `pos`.
+      data::Statistics statistics(size_t pos, ssize_t length) ;
+      //! Whether the dataset keeps summary statistics of each chunk.
+      bool has_summary(void) const ;
+      //! The number of rows in each of the dataset's chunks.
+      hsize_t chunk_rows(void) const ;
+      //! How the dataset is stored, as found from its filter pipeline.
+      StorageOptions storage_options(void) const ;
+      //! Reopen the dataset with a different chunk cache.
+      void set_chunk_cache(const ChunkCache &cache) ;
+      //! The hits and misses estimated by the dataset's `ChunkCounter`.
+      CacheStatistics cache_statistics(void) const ;
 
      protected:
+      template<typename T> bool queue(const T *data, ssize_t length, int nsignals, bool raw) ;
+      void wait(void) const ;
+      void refresh_to(size_t pos, size_t length) ;
+
       std::string m_uri ;
       H5::DataSet m_dataset ;
       hobj_ref_t m_reference ;
       int m_index ;
+      int m_rank ;
+      std::vector<hsize_t> m_shape ;  // Extent of the dataset on file
+      hsize_t m_chunkrows ;
+      bool m_live ;
+
+     private:
+      int64_t clock_size(size_t required) ;
+      template<typename T> void extend_raw(const T *data, ssize_t length, int nsignals) ;
+      void append(const double *stored, ssize_t length, int nsignals) ;
+      hsize_t append_rows(ssize_t length, int nsignals) ;
+      void write_buffer(void) ;
+      void write(const double *data, hsize_t rows) ;
+      template<typename T> size_t read_raw(size_t pos, size_t length, T *buffer) ;
+      size_t read_stored(size_t pos, size_t length, void *buffer, const H5::DataType &memtype) ;
+      void read_rows(hsize_t pos, hsize_t rows, double *buffer) ;
+      void open_summaries(void) const ;
+      std::shared_ptr<Pyramid> pyramid(void) const ;
+      std::shared_ptr<ChunkSummary> summary(void) const ;
+      void set_cache_capacity(void) ;
+      void count_chunks(hsize_t pos, hsize_t rows) ;
+      void count_chunks(hsize_t pos, hsize_t rows, hsize_t first, hsize_t last) ;
+
+      std::shared_ptr<Dataset> m_parent ;
+      std::shared_ptr<AsyncWriter> m_writer ;
+      ErrorHandler m_error_handler ;
+      mutable std::shared_ptr<Pyramid> m_pyramid ;
+      mutable std::shared_ptr<ChunkSummary> m_summary ;
+      mutable bool m_summaries_opened ;
+      std::shared_ptr<ClockData> m_clock ;
+      H5::DataSet m_clockset ;        // Used when there is no `m_clock`
+      int64_t m_clocksize ;
+      std::vector<double> m_buffer ;
+      hsize_t m_buffer_rows ;
+      std::vector<double> m_scratch ;           // Reused by planar reads
+      std::vector<double *> m_scratch_planes ;
+      hsize_t m_rowsize ;
+      hsize_t m_chunkcols ;
+      ChunkCounter m_chunkcounter ;
+      double m_gain ;                 // physical = gain*stored + offset
+      double m_offset ;
+      bool m_integer ;                // Stored as integers in [m_minstored, m_maxstored]
+      double m_minstored ;
+      double m_maxstored ;
+      friend class AsyncWriter ;
+      friend class Pyramid ;
+      friend class ChunkSummary ;
+      } ;
+
+
+    //! Summaries of a dataset's points at successively coarser resolutions,
+    //! kept in datasets next to it. Each row of level `l` has the minimum,
+    //! maximum and mean of every column over `factor^l` successive rows of
+    //! the dataset, and is added as the rows it summarises are written.
+    class Pyramid
+    /*---------*/
+    {
+     public:
+      Pyramid(Dataset *dataset, const H5::Group &group) ;
+      virtual ~Pyramid() = default ;
+
+      size_t factor(void) const ;
+      size_t levels(void) const ;
+      //! Summarise `rows` rows of stored values just written at `pos`.
+      void add(hsize_t pos, const double *stored, hsize_t rows) ;
+      void flush(void) ;
+      void close(void) ;
+      void set_live(bool live) ;
+      //! Summarise `column` of the dataset's rows `[start, end)` in at most
+      //! `maxbins` bins, using the finest level that has few enough rows and
+      //! finer levels for the partial bins at either end.
+      std::vector<Bin> envelope(int column, size_t start, size_t end, size_t maxbins) ;
 
      private:
-      int64_t clock_size(void) ;
+      struct Accumulator
+      {
+        std::vector<double> min ;
+        std::vector<double> max ;
+        std::vector<double> sum ;
+        size_t count ;          // Rows of the level below
+        std::vector<double> rows ;  // Completed rows, not yet appended
+        } ;
+
+      void accumulate(size_t level, const double *summary) ;
+      void complete(size_t level) ;
+      void append_rows(void) ;
+      void restore(hsize_t pos) ;
+      size_t level_rows(size_t level) const ;
+      void read_level(size_t level, int column, size_t first, size_t last, std::vector<Bin> &bins) ;
+      Bin summarise(size_t level, int column, size_t start, size_t end) ;
+
+      Dataset *m_dataset ;
+      size_t m_factor ;
+      size_t m_columns ;
+      std::vector<std::shared_ptr<Dataset>> m_levels ;  // Level `l` is at `l - 1`
+      std::vector<Accumulator> m_accumulators ;
+      bool m_restored ;
       } ;
 
 
-    class IndexCache
+    //! Statistics of each chunk-sized block of a dataset's rows, kept in a
+    //! dataset next to it. A row has the block's count and then the minimum,
+    //! maximum, sum and sum of squares of each column, and is added once the
+    //! block has been written. Aggregates over a range of rows combine the
+    //! rows of the blocks it covers with reads of the rows at either end.
+    class ChunkSummary
+    /*--------------*/
+    {
+     public:
+      ChunkSummary(Dataset *dataset, const H5::DataSet &summary) ;
+      virtual ~ChunkSummary() = default ;
+
+      //! The number of dataset rows in each block.
+      size_t rows(void) const ;
+      //! Summarise `rows` rows of stored values just written at `pos`.
+      void add(hsize_t pos, const double *stored, hsize_t rows) ;
+      void flush(void) ;
+      void close(void) ;
+      void set_live(bool live) ;
+      //! Statistics of `column` of the dataset's rows `[start, end)`.
+      data::Statistics statistics(int column, size_t start, size_t end) ;
+
+     private:
+      void accumulate(const double *values, hsize_t rows) ;
+      void restore(hsize_t pos) ;
+      void read_rows(int column, size_t start, size_t end, data::Statistics &stats) ;
+
+      Dataset *m_dataset ;
+      size_t m_rows ;
+      size_t m_columns ;
+      std::shared_ptr<Dataset> m_summary ;
+      std::vector<double> m_partial ;   // The block being accumulated
+      std::vector<double> m_completed ; // Completed rows, not yet appended
+      bool m_restored ;
+      } ;
+
+
+    //! Writes datasets' appends on a background thread. Appends are queued
+    //! in a fixed ring of tasks that a single caller fills and the writer
+    //! empties, with the caller blocking while the ring is full. The first
+    //! thread to queue a task becomes the only one allowed to. The HDF5
+    //! library isn't thread-safe, so callers must `sync()` before using it.
+    class AsyncWriter
+    /*-------------*/
+    {
+     public:
+      struct Task
+      {
+        Dataset *dataset ;
+        std::vector<double> data ;
+        int nsignals ;
+        bool raw ;                    // Store `data` without scaling
+        } ;
+
+      AsyncWriter(size_t length) ;
+      virtual ~AsyncWriter() ;
+
+      //! The next free task, waiting while the queue is full. Throws
+      //! any error from an earlier write, or if called from a thread other
+      //! than the one that queued the first task.
+      Task & next_task(void) ;
+      //! Queue the task returned by `next_task()`.
+      void push_task(void) ;
+      //! Wait until all queued tasks have been written, then throw any write error.
+      void sync(void) ;
+      //! Write any queued tasks and stop the writer thread.
+      void stop(void) ;
+      bool in_writer(void) const ;
+
+     private:
+      void run(void) ;
+      void fail(const std::string &error) ;
+      void check_error(void) ;
+
+      std::vector<Task> m_tasks ;
+      size_t m_mask ;
+      std::atomic<size_t> m_head ;    // Next task to write
+      std::atomic<size_t> m_tail ;    // Next task to fill
+      std::atomic<std::thread::id> m_producer ;   // The one thread filling tasks
+      std::atomic<bool> m_stopping ;
+      std::atomic<bool> m_idle ;      // The writer is waiting for tasks
+      std::atomic<bool> m_waiting ;   // The caller is waiting for the writer
+      std::atomic<bool> m_failed ;
+      std::string m_error ;
+      std::mutex m_mutex ;            // Only used to sleep and wake
+      std::condition_variable m_ready ;
+      std::condition_variable m_done ;
+      std::thread m_thread ;
+      } ;
+
+
+    class TimeIndex
+    /*-----------*/
+    {
+     public:
+      TimeIndex(ClockData *clock, size_t maxbytes) ;
+      virtual ~TimeIndex() = default ;
+
+      //! Find the smallest `n` not less than `from` with `time(n) >= t`
+      //! (`time(n) > t` if `upper` is set), or `size()` if there is none.
+      size_t search(const double t, const bool upper, size_t from=0) ;
+      //! Limit the memory used by sampled times to `maxbytes`, sampling
+      //! more sparsely as the clock grows past the limit.
+      void set_size(size_t maxbytes) ;
+
+      //! Sample `count` times being appended to the clock at `pos`.
+      void add(size_t pos, const double *times, size_t count) ;
+      //! Read any samples not yet known from the clock.
+      void fill(void) ;
+      //! Use samples previously saved with the clock.
+      void load(size_t stride, std::vector<double> &&samples) ;
+      size_t stride(void) const ;
+      const std::vector<double> &samples(void) const ;
+      //! Whether samples have been added since the index was loaded or saved.
+      bool modified(void) const ;
+      void set_modified(bool modified) ;
+      //! The number of leading samples already saved unchanged, and so
+      //! not needing to be written again.
+      size_t saved(void) const ;
+      void set_saved(size_t saved) ;
+
+     private:
+      double sample(size_t n) ;
+      void resize(size_t size) ;
+
+      ClockData *m_clock ;
+      size_t m_maxsamples ;
+      size_t m_stride ;               // Clock positions between samples
+      std::vector<double> m_samples ; // Time at every `m_stride` position, NaN until read
+      bool m_modified ;
+      size_t m_saved ;
+      } ;
+
+
+    class BlockCache
     /*------------*/
     {
      public:
-      IndexCache(const ClockData *clock, const bool right) ;
-      virtual ~IndexCache() = default ;
-
-      //! Insert `(t, index)` before `pos`.
-      void insert(const size_t pos, const double t, const ssize_t index) ;
-      //! Find first position in cache with time greater than or equal to `t`.
-      //! Returns `-1` if no such time exists.
-      ssize_t find(const double t) ;
-      //! Search `clock` for the index with time `t` and if not an exact match
-      //! return the index to the immediate left (or right if `right` set). Return
-      //! `-1` (`clock->size()`) if none to the left (right).
-      ssize_t search(size_t start, size_t end, const double t) const ;
+      BlockCache(Dataset *dataset, size_t maxbytes) ;
+      virtual ~BlockCache() = default ;
+
+      //! Get the value at `pos`, reading and caching the chunk-sized
+      //! block containing it if necessary.
+      double get(const size_t pos) ;
+      //! Limit the memory used by cached blocks to `maxbytes`.
+      void set_size(size_t maxbytes) ;
+      void clear(void) ;
 
      private:
-      const ClockData *m_clock ;
-      const bool m_right ;
-      std::vector<ssize_t> m_indexes ;
-      std::vector<double> m_times ;
+      typedef std::pair<size_t, std::vector<double>> Block ;
+
+      Dataset *m_dataset ;
+      size_t m_maxbytes ;
+      size_t m_blocksize ;
+      size_t m_maxblocks ;
+      std::list<Block> m_blocks ;   // Most recently used first
+      std::unordered_map<size_t, std::list<Block>::iterator> m_index ;
       } ;
 
 
@@ -121,14 +482,35 @@ namespace bsml {
       //! not more than `t`. i.e. smallest `n` such that `t <= time(n)`.
       //! Returns `size()` if no such `n` exists.
       size_t index_right(const double t) ;
+      //! Find both `index_right(start)` and `index(end)`, starting
+      //! the second search from where the first finished.
+      std::pair<size_t, ssize_t> index_range(const double start, const double end) ;
+      //! Limit the memory used to cache blocks of times to `maxbytes`.
+      void set_cache_size(size_t maxbytes) ;
+      //! Limit the memory used by the sparse time index to `maxbytes`.
+      void set_index_size(size_t maxbytes) ;
+
+      void extend(const double *data, ssize_t length, int nsignals) override ;
+      void close(void) override ;
+      //! Save the sparse time index next to the clock, if it has changed.
+      //! Samples added by `extend()` are only kept in memory until this is
+      //! called, as it is by `close()` and `Recording::flush()`.
+      void save_index(void) ;
+      //! Read every sampled time from the clock and save the index.
+      void rebuild_index(void) ;
+      //! Make sure the index dataset exists, as it can't be created once
+      //! the file is being written in SWMR mode.
+      void create_index(void) ;
 
      private:
       friend class Clock ;
-      friend class IndexCache ;
-      double read_time(size_t pos) const ;
+      friend class TimeIndex ;
+      double read_time(size_t pos) ;
+      void load_index(void) ;
+      void refresh_after(const double t) ;
 
-      IndexCache m_leftcache ;
-      IndexCache m_rightcache ;
+      BlockCache m_blockcache ;
+      TimeIndex m_timeindex ;
       } ;
 
 
@@ -152,26 +534,42 @@ namespace bsml {
       File(H5::H5File h5file, const std::string &uri) ;
       ~File(void) ;
 
-      static File *create(const std::string &uri, const std::string &fname, bool replace=false) ;
-      static File *open(const std::string &fname, bool readonly=false) ;
+      //! With `swmr` the file is created in the latest format, so that
+      //! `start_swmr_write()` can later let readers open it while it's written.
+      static File *create(const std::string &uri, const std::string &fname, bool replace=false,
+                          const ChunkCache &cache=ChunkCache(), bool swmr=false) ;
+      //! With `swmr` a readonly file is opened for reading while another
+      //! process writes it, and a writable file is opened for SWMR writing.
+      static File *open(const std::string &fname, bool readonly=false,
+                        const ChunkCache &cache=ChunkCache(), bool swmr=false) ;
+      //! Allow SWMR readers. No datasets or attributes can be created afterwards.
+      void start_swmr_write(void) ;
       void close(void) ;
       const std::string get_uri(void) const ;
+      //! Write all of the file's cached data and metadata to storage.
+      void flush(void) ;
+      //! Don't flush the file each time a dataset is created or metadata is
+      //! stored, leaving this to `flush()` or `close()`.
+      void set_deferred_flush(bool defer) ;
 
       SignalData::Ptr create_signal(const std::string &uri, const std::string &units,
         const double *data=nullptr, size_t datasize=0, std::vector<hsize_t> datashape=std::vector<hsize_t>(),
-        double gain=1.0, double offset=0.0, double rate=0.0, ClockData::Ptr clock=nullptr) ;
+        double gain=1.0, double offset=0.0, double rate=0.0, ClockData::Ptr clock=nullptr,
+        const StorageOptions &options=StorageOptions()) ;
       SignalData::Ptr create_signal(const std::vector<std::string> &uris,
         const std::vector<std::string> &units,
         const double *data=nullptr, size_t datasize=0,
-        double gain=1.0, double offset=0.0, double rate=0.0, ClockData::Ptr clock=nullptr) ;
+        double gain=1.0, double offset=0.0, double rate=0.0, ClockData::Ptr clock=nullptr,
+        const StorageOptions &options=StorageOptions()) ;
 
       SignalData::Ptr get_signal(const std::string &uri) ;
       std::list<SignalData::Ptr> get_signals(void) ;
 
       ClockData::Ptr create_clock(const std::string &uri, const std::string &units,
-        double rate, const double *data=nullptr, size_t datasize=0) ;
+        double rate, const double *data=nullptr, size_t datasize=0,
+        const StorageOptions &options=StorageOptions()) ;
       ClockData::Ptr create_clock(const std::string &uri, const std::string &units,
-        const double *data, size_t datasize) ;
+        const double *data, size_t datasize, const StorageOptions &options=StorageOptions()) ;
 
       ClockData::Ptr get_clock(const std::string &uri) ;
       std::list<ClockData::Ptr> get_clocks(void) ;
@@ -182,15 +580,19 @@ namespace bsml {
      private:
       DatasetRef get_dataref(const std::string &uri, const std::string &prefix) ;
       DatasetRef create_dataset(const std::string &group, int rank,
-        hsize_t *shape, hsize_t *maxshape, const double *data) ;
+        hsize_t *shape, hsize_t *maxshape, const StorageOptions &options) ;
 
       void set_signal_attributes(const H5::DataSet &dset, double gain=1.0, double offset=0.0,
         double rate=0.0, const std::string &timeunits="", const ClockData::Ptr &clock=nullptr) ;
+      void create_pyramid(const H5::DataSet &dset, hsize_t columns, const StorageOptions &options) ;
+      void create_summary(const H5::DataSet &dset, hsize_t columns, const StorageOptions &options) ;
       ClockData::Ptr check_timing(double rate, const std::string &uri, size_t npoints) ;
+      void flush_updates(void) ;
 
       H5::H5File m_h5file ;
       std::string m_uri ;
       bool m_closed ;
+      bool m_deferflush ;
       } ;
 
     } ;
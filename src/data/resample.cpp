@@ -0,0 +1,202 @@
+/******************************************************************************
+ *                                                                            *
+ *  BioSignalML Management in C++                                             *
+ *                                                                            *
+ *  Copyright (c) 2010-2015  David Brooks                                     *
+ *                                                                            *
+ *  Licensed under the Apache License, Version 2.0 (the "License");           *
+ *  you may not use this file except in compliance with the License.          *
+ *  You may obtain a copy of the License at                                   *
+ *                                                                            *
+ *      http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                            *
+ *  Unless required by applicable law or agreed to in writing, software       *
+ *  distributed under the License is distributed on an "AS IS" BASIS,         *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ *  See the License for the specific language governing permissions and       *
+ *  limitations under the License.                                            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "resample.h"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BSML_RESAMPLE_X86
+#include <immintrin.h>
+#endif
+
+
+using namespace bsml ;
+
+
+static double dot_product_generic(const double *a, const double *b, size_t length)
+/*------------------------------------------------------------------------------*/
+{
+  double sum = 0.0 ;
+  for (size_t n = 0 ;  n < length ;  ++n) sum += a[n]*b[n] ;
+  return sum ;
+  }
+
+
+#ifdef BSML_RESAMPLE_X86
+
+__attribute__((target("sse2")))
+static double dot_product_sse2(const double *a, const double *b, size_t length)
+/*---------------------------------------------------------------------------*/
+{
+  __m128d s0 = _mm_setzero_pd() ;
+  __m128d s1 = _mm_setzero_pd() ;
+  size_t block = length & ~(size_t)3 ;
+  for (size_t n = 0 ;  n < block ;  n += 4) {
+    s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + n), _mm_loadu_pd(b + n))) ;
+    s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + n + 2), _mm_loadu_pd(b + n + 2))) ;
+    }
+  double sums[2] ;
+  _mm_storeu_pd(sums, _mm_add_pd(s0, s1)) ;
+  return sums[0] + sums[1] + dot_product_generic(a + block, b + block, length - block) ;
+  }
+
+__attribute__((target("avx")))
+static double dot_product_avx(const double *a, const double *b, size_t length)
+/*--------------------------------------------------------------------------*/
+{
+  __m256d s0 = _mm256_setzero_pd() ;
+  __m256d s1 = _mm256_setzero_pd() ;
+  size_t block = length & ~(size_t)7 ;
+  for (size_t n = 0 ;  n < block ;  n += 8) {
+    s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + n), _mm256_loadu_pd(b + n))) ;
+    s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + n + 4), _mm256_loadu_pd(b + n + 4))) ;
+    }
+  double sums[4] ;
+  _mm256_storeu_pd(sums, _mm256_add_pd(s0, s1)) ;
+  return (sums[0] + sums[1]) + (sums[2] + sums[3])
+       + dot_product_generic(a + block, b + block, length - block) ;
+  }
+
+#endif
+
+
+typedef double (*DotProductFunction)(const double *, const double *, size_t) ;
+
+static DotProductFunction select_dot_product(void)
+/*----------------------------------------------*/
+{
+#ifdef BSML_RESAMPLE_X86
+  __builtin_cpu_init() ;
+  if (__builtin_cpu_supports("avx")) return dot_product_avx ;
+  if (__builtin_cpu_supports("sse2")) return dot_product_sse2 ;
+#endif
+  return dot_product_generic ;
+  }
+
+
+double data::dot_product(const double *a, const double *b, size_t length)
+/*---------------------------------------------------------------------*/
+{
+  static const DotProductFunction function = select_dot_product() ;
+  return function(a, b, length) ;
+  }
+
+
+void data::interpolate(const double *times, const double *values, size_t length,
+/*----------------------------------------------------------------------------*/
+                       double start, double period, size_t count,
+                       Interpolation method, double *output)
+{
+  size_t j = 0 ;    // times[j] <= t < times[j+1]
+  for (size_t n = 0 ;  n < count ;  ++n) {
+    double t = start + n*period ;
+    while ((j + 1) < length && times[j + 1] <= t) ++j ;
+    if (length == 0) output[n] = NAN ;
+    else if (t <= times[0]) output[n] = values[0] ;
+    else if ((j + 1) >= length) output[n] = values[length - 1] ;
+    else if (method == Interpolation::NEAREST)
+      output[n] = ((t - times[j]) <= (times[j + 1] - t)) ? values[j] : values[j + 1] ;
+    else
+      output[n] = values[j] + (values[j + 1] - values[j])*(t - times[j])/(times[j + 1] - times[j]) ;
+    }
+  }
+
+
+void data::interpolate(const TimeSeriesView &series, double start, double period,
+/*----------------------------------------------------------------------------*/
+                       size_t count, Interpolation method, double *output)
+{
+  if (!series.uniform() || series.size() == 0) {
+    interpolate(series.times(), series.data(), series.size(), start, period, count, method, output) ;
+    return ;
+    }
+  // Uniform points are found directly from a time's fractional position
+  const double *values = series.data() ;
+  const size_t last = series.size() - 1 ;
+  for (size_t n = 0 ;  n < count ;  ++n) {
+    double x = (start + n*period - series.time(0))*series.rate() ;
+    if (x <= 0.0) output[n] = values[0] ;
+    else if (x >= (double)last) output[n] = values[last] ;
+    else {
+      size_t i = (size_t)x ;
+      double fraction = x - (double)i ;
+      if (method == Interpolation::NEAREST) output[n] = (fraction <= 0.5) ? values[i] : values[i + 1] ;
+      else output[n] = values[i] + (values[i + 1] - values[i])*fraction ;
+      }
+    }
+  }
+
+
+data::Resampler::Resampler(double ratio)
+/*====================================*/
+: m_ratio(ratio),
+  m_cutoff(0.5*BSML_RESAMPLE_CUTOFF/ratio),
+  m_halfwidth((size_t)std::ceil(BSML_RESAMPLE_ZEROS*ratio)),
+  m_phases(BSML_RESAMPLE_PHASES)
+{
+  }
+
+size_t data::Resampler::half_width(void) const
+/*------------------------------------------*/
+{
+  return m_halfwidth ;
+  }
+
+const std::vector<double> &data::Resampler::phase(size_t n)
+/*-------------------------------------------------------*/
+{
+  std::vector<double> &filter = m_phases[n] ;
+  if (filter.empty()) {
+    // Coefficient `j` multiplies the point `j - halfwidth` from the position's
+    // integer part, which is `n/phases` of a point before the position.
+    const double width = (double)(m_halfwidth + 1) ;
+    const double shift = (double)n/BSML_RESAMPLE_PHASES ;
+    filter.resize(2*m_halfwidth + 2) ;
+    double sum = 0.0 ;
+    for (size_t j = 0 ;  j < filter.size() ;  ++j) {
+      double d = (double)j - (double)m_halfwidth - shift ;
+      double x = 2.0*M_PI*m_cutoff*d ;
+      double window = (std::fabs(d) >= width) ? 0.0
+                    : 0.42 + 0.5*std::cos(M_PI*d/width) + 0.08*std::cos(2.0*M_PI*d/width) ;
+      filter[j] = window*((d == 0.0) ? 1.0 : std::sin(x)/x) ;
+      sum += filter[j] ;
+      }
+    for (auto &c : filter) c /= sum ;    // Unit gain for a constant signal
+    }
+  return filter ;
+  }
+
+void data::Resampler::resample(const double *input, double position, size_t count, double *output)
+/*----------------------------------------------------------------------------------------------*/
+{
+  for (size_t n = 0 ;  n < count ;  ++n) {
+    double x = position + n*m_ratio ;
+    double whole = std::floor(x) ;
+    size_t p = (size_t)std::lround((x - whole)*BSML_RESAMPLE_PHASES) ;
+    size_t i = (size_t)whole ;
+    if (p == BSML_RESAMPLE_PHASES) {
+      p = 0 ;
+      i += 1 ;
+      }
+    const std::vector<double> &filter = phase(p) ;
+    output[n] = dot_product(filter.data(), input + i - m_halfwidth, filter.size()) ;
+    }
+  }
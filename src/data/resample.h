@@ -0,0 +1,83 @@
+/******************************************************************************
+ *                                                                            *
+ *  BioSignalML Management in C++                                             *
+ *                                                                            *
+ *  Copyright (c) 2010-2015  David Brooks                                     *
+ *                                                                            *
+ *  Licensed under the Apache License, Version 2.0 (the "License");           *
+ *  you may not use this file except in compliance with the License.          *
+ *  You may obtain a copy of the License at                                   *
+ *                                                                            *
+ *      http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                            *
+ *  Unless required by applicable law or agreed to in writing, software       *
+ *  distributed under the License is distributed on an "AS IS" BASIS,         *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ *  See the License for the specific language governing permissions and       *
+ *  limitations under the License.                                            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef BSML_RESAMPLE_H
+#define BSML_RESAMPLE_H
+
+#include <biosignalml/biosignalml_export.h>
+#include <biosignalml/data/timeseries.h>
+
+#include <cstddef>
+#include <vector>
+
+
+#define BSML_RESAMPLE_CUTOFF      0.8    // Filter cutoff, as a fraction of the new Nyquist frequency
+#define BSML_RESAMPLE_ZEROS       16     // Filter half-width, in multiples of the new point spacing
+#define BSML_RESAMPLE_PHASES      256    // Fractional positions a filter is evaluated at
+
+
+namespace bsml {
+
+  namespace data {
+
+    //! The sum of `a[i]*b[i]` for `i < length`.
+    BIOSIGNALML_EXPORT double dot_product(const double *a, const double *b, size_t length) ;
+
+    //! Interpolate `count` values at times `start + n*period` from `length` points
+    //! with ascending `times`. Values at times outside of `times` are the end points.
+    BIOSIGNALML_EXPORT void interpolate(const double *times, const double *values, size_t length,
+                                        double start, double period, size_t count,
+                                        Interpolation method, double *output) ;
+    //! Interpolate `count` values at times `start + n*period` from a view's points.
+    BIOSIGNALML_EXPORT void interpolate(const TimeSeriesView &series, double start, double period,
+                                        size_t count, Interpolation method, double *output) ;
+
+
+    //! Lowpass filters points to remove what would alias when they are resampled
+    //! with a wider spacing. The filter is a Blackman windowed sinc, evaluated with
+    //! a polyphase bank of coefficients so that only the kept points are computed.
+    class BIOSIGNALML_EXPORT Resampler
+    /*------------------------------*/
+    {
+     public:
+      //! Resample at `ratio` (at least one) times the spacing of the input points.
+      Resampler(double ratio) ;
+
+      //! The number of input points a filtered value needs either side of its position.
+      size_t half_width(void) const ;
+      //! Filter at the positions `position + n*ratio` of `input`, for `n < count`.
+      //! The input must extend `half_width()` points before the first position
+      //! and `half_width() + 2` points after the last.
+      void resample(const double *input, double position, size_t count, double *output) ;
+
+     private:
+      const std::vector<double> &phase(size_t n) ;
+
+      double m_ratio ;
+      double m_cutoff ;
+      size_t m_halfwidth ;
+      std::vector<std::vector<double>> m_phases ;   // Made when first used
+      } ;
+
+    } ;
+
+  } ;
+
+#endif
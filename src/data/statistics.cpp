@@ -0,0 +1,421 @@
+/******************************************************************************
+ *                                                                            *
+ *  BioSignalML Management in C++                                             *
+ *                                                                            *
+ *  Copyright (c) 2010-2015  David Brooks                                     *
+ *                                                                            *
+ *  Licensed under the Apache License, Version 2.0 (the "License");           *
+ *  you may not use this file except in compliance with the License.          *
+ *  You may obtain a copy of the License at                                   *
+ *                                                                            *
+ *      http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                            *
+ *  Unless required by applicable law or agreed to in writing, software       *
+ *  distributed under the License is distributed on an "AS IS" BASIS,         *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ *  See the License for the specific language governing permissions and       *
+ *  limitations under the License.                                            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include <biosignalml/data/statistics.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BSML_STATISTICS_X86
+#include <immintrin.h>
+#endif
+
+
+#define BSML_STATISTICS_BLOCK   4096    // Values summed about a common shift
+#define BSML_PERCENTILE_BINS    1024    // Histogram bins used to narrow a percentile's range
+
+
+using namespace bsml ;
+
+
+// Blocks of values are reduced to their extremes and the sums of their differences,
+// and squared differences, from a shift near to them, using the widest SIMD
+// instruction set the CPU supports. Blocks are then merged as separate sets.
+
+struct Moments
+{
+  double min ;
+  double max ;
+  double sum ;      // Of `value - shift`
+  double sumsq ;
+  } ;
+
+static void moments_generic(const double *values, size_t count, double shift, Moments &m)
+/*-------------------------------------------------------------------------------------*/
+{
+  for (size_t n = 0 ;  n < count ;  ++n) {
+    double x = values[n] ;
+    double d = x - shift ;
+    m.min = (x < m.min) ? x : m.min ;
+    m.max = (x > m.max) ? x : m.max ;
+    m.sum += d ;
+    m.sumsq += d*d ;
+    }
+  }
+
+
+#ifdef BSML_STATISTICS_X86
+
+__attribute__((target("sse2")))
+static void moments_sse2(const double *values, size_t count, double shift, Moments &m)
+/*----------------------------------------------------------------------------------*/
+{
+  __m128d lo = _mm_set1_pd(m.min), hi = _mm_set1_pd(m.max) ;
+  __m128d s = _mm_setzero_pd(), ss = _mm_setzero_pd() ;
+  __m128d sh = _mm_set1_pd(shift) ;
+  size_t block = count & ~(size_t)1 ;
+  for (size_t n = 0 ;  n < block ;  n += 2) {
+    __m128d x = _mm_loadu_pd(values + n) ;
+    __m128d d = _mm_sub_pd(x, sh) ;
+    lo = _mm_min_pd(x, lo) ;
+    hi = _mm_max_pd(x, hi) ;
+    s = _mm_add_pd(s, d) ;
+    ss = _mm_add_pd(ss, _mm_mul_pd(d, d)) ;
+    }
+  double l[2], h[2], a[2], b[2] ;
+  _mm_storeu_pd(l, lo) ;
+  _mm_storeu_pd(h, hi) ;
+  _mm_storeu_pd(a, s) ;
+  _mm_storeu_pd(b, ss) ;
+  m.min = std::min(l[0], l[1]) ;
+  m.max = std::max(h[0], h[1]) ;
+  m.sum += a[0] + a[1] ;
+  m.sumsq += b[0] + b[1] ;
+  moments_generic(values + block, count - block, shift, m) ;
+  }
+
+__attribute__((target("avx2,fma")))
+static void moments_avx2(const double *values, size_t count, double shift, Moments &m)
+/*----------------------------------------------------------------------------------*/
+{
+  __m256d lo = _mm256_set1_pd(m.min), hi = _mm256_set1_pd(m.max) ;
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd() ;
+  __m256d ss0 = _mm256_setzero_pd(), ss1 = _mm256_setzero_pd() ;
+  __m256d sh = _mm256_set1_pd(shift) ;
+  size_t block = count & ~(size_t)7 ;
+  for (size_t n = 0 ;  n < block ;  n += 8) {
+    __m256d x0 = _mm256_loadu_pd(values + n) ;
+    __m256d x1 = _mm256_loadu_pd(values + n + 4) ;
+    __m256d d0 = _mm256_sub_pd(x0, sh) ;
+    __m256d d1 = _mm256_sub_pd(x1, sh) ;
+    lo = _mm256_min_pd(x0, _mm256_min_pd(x1, lo)) ;
+    hi = _mm256_max_pd(x0, _mm256_max_pd(x1, hi)) ;
+    s0 = _mm256_add_pd(s0, d0) ;
+    s1 = _mm256_add_pd(s1, d1) ;
+    ss0 = _mm256_fmadd_pd(d0, d0, ss0) ;
+    ss1 = _mm256_fmadd_pd(d1, d1, ss1) ;
+    }
+  double l[4], h[4], a[4], b[4] ;
+  _mm256_storeu_pd(l, lo) ;
+  _mm256_storeu_pd(h, hi) ;
+  _mm256_storeu_pd(a, _mm256_add_pd(s0, s1)) ;
+  _mm256_storeu_pd(b, _mm256_add_pd(ss0, ss1)) ;
+  m.min = std::min(std::min(l[0], l[1]), std::min(l[2], l[3])) ;
+  m.max = std::max(std::max(h[0], h[1]), std::max(h[2], h[3])) ;
+  m.sum += (a[0] + a[1]) + (a[2] + a[3]) ;
+  m.sumsq += (b[0] + b[1]) + (b[2] + b[3]) ;
+  moments_generic(values + block, count - block, shift, m) ;
+  }
+
+__attribute__((target("avx512f")))
+static void moments_avx512(const double *values, size_t count, double shift, Moments &m)
+/*------------------------------------------------------------------------------------*/
+{
+  __m512d lo = _mm512_set1_pd(m.min), hi = _mm512_set1_pd(m.max) ;
+  __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd() ;
+  __m512d ss0 = _mm512_setzero_pd(), ss1 = _mm512_setzero_pd() ;
+  __m512d sh = _mm512_set1_pd(shift) ;
+  const __mmask8 all = 0xFF ;
+  size_t block = count & ~(size_t)15 ;
+  for (size_t n = 0 ;  n < block ;  n += 16) {
+    __m512d x0 = _mm512_loadu_pd(values + n) ;
+    __m512d x1 = _mm512_loadu_pd(values + n + 8) ;
+    __m512d d0 = _mm512_sub_pd(x0, sh) ;
+    __m512d d1 = _mm512_sub_pd(x1, sh) ;
+    // Masked forms, as GCC's plain _mm512_min_pd() passes through an undefined vector
+    lo = _mm512_mask_min_pd(lo, all, x0, _mm512_mask_min_pd(lo, all, x1, lo)) ;
+    hi = _mm512_mask_max_pd(hi, all, x0, _mm512_mask_max_pd(hi, all, x1, hi)) ;
+    s0 = _mm512_add_pd(s0, d0) ;
+    s1 = _mm512_add_pd(s1, d1) ;
+    ss0 = _mm512_fmadd_pd(d0, d0, ss0) ;
+    ss1 = _mm512_fmadd_pd(d1, d1, ss1) ;
+    }
+  double l[8], h[8], a[8], b[8] ;
+  _mm512_storeu_pd(l, lo) ;
+  _mm512_storeu_pd(h, hi) ;
+  _mm512_storeu_pd(a, _mm512_add_pd(s0, s1)) ;
+  _mm512_storeu_pd(b, _mm512_add_pd(ss0, ss1)) ;
+  m.min = l[0] ;
+  m.max = h[0] ;
+  double sum = 0.0, sumsq = 0.0 ;
+  for (int n = 0 ;  n < 8 ;  ++n) {
+    m.min = std::min(m.min, l[n]) ;
+    m.max = std::max(m.max, h[n]) ;
+    sum += a[n] ;
+    sumsq += b[n] ;
+    }
+  m.sum += sum ;
+  m.sumsq += sumsq ;
+  moments_generic(values + block, count - block, shift, m) ;
+  }
+
+#endif
+
+
+typedef void (*MomentsFunction)(const double *, size_t, double, Moments &) ;
+
+static MomentsFunction select_moments(void)
+/*---------------------------------------*/
+{
+#ifdef BSML_STATISTICS_X86
+  __builtin_cpu_init() ;
+  if (__builtin_cpu_supports("avx512f")) return moments_avx512 ;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return moments_avx2 ;
+  if (__builtin_cpu_supports("sse2")) return moments_sse2 ;
+#endif
+  return moments_generic ;
+  }
+
+
+data::Statistics::Statistics()
+/*==========================*/
+: m_count(0),
+  m_min(std::numeric_limits<double>::infinity()),
+  m_max(-std::numeric_limits<double>::infinity()),
+  m_mean(0.0),
+  m_m2(0.0)
+{
+  }
+
+// The variance of values far from zero loses precision when found from
+// their sums, which is why blocks are otherwise shifted by their first value.
+data::Statistics::Statistics(size_t count, double min, double max, double sum, double sumsq)
+/*========================================================================================*/
+: m_count(count),
+  m_min(min),
+  m_max(max),
+  m_mean(count ? sum/count : 0.0),
+  m_m2(count ? std::max(0.0, sumsq - sum*sum/count) : 0.0)
+{
+  }
+
+void data::Statistics::add(const double *values, const size_t count)
+/*----------------------------------------------------------------*/
+{
+  static const MomentsFunction moments = select_moments() ;
+  for (size_t pos = 0 ;  pos < count ;  pos += BSML_STATISTICS_BLOCK) {
+    const size_t length = std::min((size_t)BSML_STATISTICS_BLOCK, count - pos) ;
+    const double shift = values[pos] ;
+    Moments m = { values[pos], values[pos], 0.0, 0.0 } ;
+    moments(values + pos, length, shift, m) ;
+    Statistics block ;
+    block.m_count = length ;
+    block.m_min = m.min ;
+    block.m_max = m.max ;
+    block.m_mean = shift + m.sum/length ;
+    block.m_m2 = std::max(0.0, m.sumsq - m.sum*m.sum/length) ;
+    merge(block) ;
+    }
+  }
+
+void data::Statistics::merge(const Statistics &other)
+/*-------------------------------------------------*/
+{
+  if (other.m_count == 0) return ;
+  if (m_count == 0) {
+    *this = other ;
+    return ;
+    }
+  const double total = (double)(m_count + other.m_count) ;
+  const double delta = other.m_mean - m_mean ;
+  m_mean += delta*(double)other.m_count/total ;
+  m_m2 += other.m_m2 + delta*delta*(double)m_count*(double)other.m_count/total ;
+  m_min = std::min(m_min, other.m_min) ;
+  m_max = std::max(m_max, other.m_max) ;
+  m_count += other.m_count ;
+  }
+
+double data::Statistics::min(void) const
+/*------------------------------------*/
+{
+  return m_count ? m_min : NAN ;
+  }
+
+double data::Statistics::max(void) const
+/*------------------------------------*/
+{
+  return m_count ? m_max : NAN ;
+  }
+
+double data::Statistics::mean(void) const
+/*-------------------------------------*/
+{
+  return m_count ? m_mean : NAN ;
+  }
+
+double data::Statistics::variance(void) const
+/*-----------------------------------------*/
+{
+  return m_count ? m_m2/(double)m_count : NAN ;
+  }
+
+double data::Statistics::standard_deviation(void) const
+/*---------------------------------------------------*/
+{
+  return std::sqrt(variance()) ;
+  }
+
+double data::Statistics::rms(void) const
+/*------------------------------------*/
+{
+  return m_count ? std::sqrt(m_m2/(double)m_count + m_mean*m_mean) : NAN ;
+  }
+
+
+data::Statistics data::statistics(const double *values, const size_t count)
+/*-----------------------------------------------------------------------*/
+{
+  Statistics result ;
+  result.add(values, count) ;
+  return result ;
+  }
+
+data::Statistics data::statistics(const TimeSeriesView &series)
+/*-----------------------------------------------------------*/
+{
+  return statistics(series.data(), series.size()) ;
+  }
+
+data::Statistics data::statistics(const TimeSeries &series)
+/*-------------------------------------------------------*/
+{
+  return statistics(series.view()) ;
+  }
+
+data::Statistics data::statistics(const ValueReader &reader, const size_t count, const size_t block)
+/*------------------------------------------------------------------------------------------------*/
+{
+  Statistics result ;
+  std::vector<double> buffer(std::max(block, (size_t)1)) ;
+  for (size_t pos = 0 ;  pos < count ;  ) {
+    size_t length = reader(pos, std::min(buffer.size(), count - pos), buffer.data()) ;
+    if (length == 0) break ;
+    result.add(buffer.data(), length) ;
+    pos += length ;
+    }
+  return result ;
+  }
+
+
+// The rank, and the fraction of the way to the next rank, of a percentile.
+static std::pair<size_t, double> percentile_rank(const size_t count, const double p)
+/*--------------------------------------------------------------------------------*/
+{
+  double rank = std::min(std::max(p, 0.0), 100.0)*(double)(count - 1)/100.0 ;
+  size_t lower = (size_t)std::floor(rank) ;
+  return std::make_pair(lower, rank - (double)lower) ;
+  }
+
+double data::percentile(const double *values, const size_t count, const double p)
+/*-----------------------------------------------------------------------------*/
+{
+  if (count == 0) return NAN ;
+  std::vector<double> selected(values, values + count) ;
+  auto rank = percentile_rank(count, p) ;
+  auto lower = selected.begin() + rank.first ;
+  std::nth_element(selected.begin(), lower, selected.end()) ;
+  if (rank.second == 0.0) return *lower ;
+  // Everything after the `rank`th value is at least as large,
+  // so the next ranked value is the smallest of them.
+  double next = *std::min_element(lower + 1, selected.end()) ;
+  return *lower + rank.second*(next - *lower) ;
+  }
+
+double data::percentile(const TimeSeriesView &series, const double p)
+/*-----------------------------------------------------------------*/
+{
+  return percentile(series.data(), series.size(), p) ;
+  }
+
+double data::percentile(const TimeSeries &series, const double p)
+/*-------------------------------------------------------------*/
+{
+  return percentile(series.view(), p) ;
+  }
+
+double data::percentile(const ValueReader &reader, const size_t count, const double p,
+/*----------------------------------------------------------------------------------*/
+                        const size_t block)
+{
+  Statistics stats = statistics(reader, count, block) ;
+  if (stats.count() == 0) return NAN ;
+  auto rank = percentile_rank(stats.count(), p) ;
+  size_t first = rank.first ;
+  size_t last = (rank.second > 0.0) ? (first + 1) : first ;
+  std::vector<double> buffer(std::max(block, (size_t)1)) ;
+  auto each = [&](const std::function<void(double)> &use) {
+    for (size_t pos = 0 ;  pos < count ;  ) {
+      size_t length = reader(pos, std::min(buffer.size(), count - pos), buffer.data()) ;
+      if (length == 0) break ;
+      for (size_t n = 0 ;  n < length ;  ++n) use(buffer[n]) ;
+      pos += length ;
+      }
+    } ;
+  auto result = [&](double lower, double upper) -> double {
+    return lower + rank.second*(upper - lower) ;
+    } ;
+
+  // The values in [lo, hi] are candidates, with `below` values less than `lo`.
+  // Each pass counts the candidates in bins between `lo` and `hi`, keeping the
+  // extremes of each bin. As bins increase with value, only those in the bins
+  // holding the ranks we want remain candidates.
+  double lo = stats.min(), hi = stats.max() ;
+  size_t below = 0, candidates = stats.count() ;
+  while (candidates > buffer.size()) {
+    if (lo == hi) return lo ;
+    std::vector<size_t> counts(BSML_PERCENTILE_BINS, 0) ;
+    std::vector<double> mins(BSML_PERCENTILE_BINS, hi), maxs(BSML_PERCENTILE_BINS, lo) ;
+    const double scale = BSML_PERCENTILE_BINS/(0.5*hi - 0.5*lo) ;   // Halved to avoid overflow
+    each([&](double x) {
+      if (x >= lo && x <= hi) {
+        size_t bin = std::min((size_t)((0.5*x - 0.5*lo)*scale), (size_t)BSML_PERCENTILE_BINS - 1) ;
+        ++counts[bin] ;
+        mins[bin] = std::min(mins[bin], x) ;
+        maxs[bin] = std::max(maxs[bin], x) ;
+        }
+      }) ;
+    size_t bin = 0, start = below ;
+    while ((start + counts[bin]) <= first) start += counts[bin++] ;
+    if ((start + counts[bin]) <= last) {
+      // The ranks are the largest in one bin and the smallest in a later one
+      size_t next = bin + 1 ;
+      while (counts[next] == 0) ++next ;
+      return result(maxs[bin], mins[next]) ;
+      }
+    if (counts[bin] == candidates) break ;  // No narrower, so select from them all
+    lo = mins[bin] ;
+    hi = maxs[bin] ;
+    below = start ;
+    candidates = counts[bin] ;
+    }
+
+  std::vector<double> selected ;
+  selected.reserve(candidates) ;
+  each([&](double x) {
+    if (x >= lo && x <= hi) selected.push_back(x) ;
+    }) ;
+  auto lower = selected.begin() + (first - below) ;
+  std::nth_element(selected.begin(), lower, selected.end()) ;
+  if (last == first) return *lower ;
+  return result(*lower, *std::min_element(lower + 1, selected.end())) ;
+  }
@@ -21,30 +21,185 @@
 #include <biosignalml/data/timeseries.h>
 
 #include <cassert>
+#include <cstdint>
 #include <algorithm>
+#include <utility>
 
 
 using namespace bsml ;
 
+
+// The times `start + n/rate` of points `begin` up to `end`, as `time(n)` would give
+// them. Indices within a block are 32-bit so that the loop can be vectorised.
+static void uniform_times(double rate, double start, size_t begin, size_t end, double *times)
+/*-----------------------------------------------------------------------------------------*/
+{
+  for (size_t pos = begin ;  pos < end ;  ) {
+    const int32_t count = (int32_t)std::min(end - pos, (size_t)INT32_MAX) ;
+    const double first = (double)pos ;
+    for (int32_t n = 0 ;  n < count ;  ++n) times[n] = start + (first + (double)n)/rate ;
+    times += count ;
+    pos += count ;
+    }
+  }
+
+
+data::TimeSeriesView::TimeSeriesView()
+/*==================================*/
+: m_data(nullptr), m_times(nullptr), m_size(0), m_rate(0.0), m_start(0.0)
+{
+  }
+
+data::TimeSeriesView::TimeSeriesView(const double *data, const size_t size, const double rate,
+/*==========================================================================================*/
+                                     const double start)
+: m_data(data), m_times(nullptr), m_size(size), m_rate(rate), m_start(start)
+{
+  }
+
+data::TimeSeriesView::TimeSeriesView(const double *data, const size_t size, const double *times)
+/*============================================================================================*/
+: m_data(data), m_times(times), m_size(size), m_rate(0.0), m_start(0.0)
+{
+  assert(times != nullptr || size == 0) ;
+  }
+
+double data::TimeSeriesView::duration(void) const
+/*---------------------------------------------*/
+{
+  return (m_size > 1) ? (time(m_size - 1) - time(0)) : 0.0 ;
+  }
+
+size_t data::TimeSeriesView::search(const double t, const bool upper, const size_t hint) const
+/*---------------------------------------------------------------------------------------*/
+{
+  // Return the first point after `t`, or if not `upper` the first not before `t`.
+  if (m_size == 0) return 0 ;
+  auto before = [&](size_t n) -> bool {
+    return upper ? (time(n) <= t) : (time(n) < t) ;
+    } ;
+  size_t guess = hint ;
+  if (m_times == nullptr || guess >= m_size) {
+    // Guess where `t` is from the rate, or by interpolating between the first and last times
+    double span = time(m_size - 1) - time(0) ;
+    double x = (m_times == nullptr) ? (t - m_start)*m_rate
+             : (span > 0.0) ? (t - time(0))*(double)(m_size - 1)/span : 0.0 ;
+    guess = !(x > 0.0) ? 0 : (x >= (double)(m_size - 1)) ? (m_size - 1) : (size_t)x ;
+    }
+  if (m_times == nullptr) {
+    // A uniform guess is at most a rounding error out
+    while (guess < m_size && before(guess)) ++guess ;
+    while (guess > 0 && !before(guess - 1)) --guess ;
+    return guess ;
+    }
+  // Gallop away from the guess in doubling steps to bracket
+  // the position, then binary search within the bracket.
+  size_t lo, hi ;
+  if (before(guess)) {
+    lo = guess + 1 ;
+    hi = m_size ;
+    for (size_t step = 1 ;  guess + step < m_size ;  step *= 2) {
+      if (!before(guess + step)) {
+        hi = guess + step ;
+        break ;
+        }
+      lo = guess + step + 1 ;
+      }
+    }
+  else {
+    lo = 0 ;
+    hi = guess ;
+    for (size_t step = 1 ;  step <= guess ;  step *= 2) {
+      if (before(guess - step)) {
+        lo = guess - step + 1 ;
+        break ;
+        }
+      hi = guess - step ;
+      }
+    }
+  while (lo < hi) {
+    size_t mid = (lo + hi)/2 ;
+    if (before(mid)) lo = mid + 1 ;
+    else             hi = mid ;
+    }
+  return lo ;
+  }
+
+ssize_t data::TimeSeriesView::index(const double t) const
+/*-----------------------------------------------------*/
+{
+  return (ssize_t)search(t, true, m_size) - 1 ;
+  }
+
+size_t data::TimeSeriesView::index_right(const double t) const
+/*----------------------------------------------------------*/
+{
+  return search(t, false, m_size) ;
+  }
+
+void data::TimeSeriesView::index(const double *times, const size_t count, ssize_t *indices) const
+/*---------------------------------------------------------------------------------------------*/
+{
+  size_t found = m_size ;
+  for (size_t n = 0 ;  n < count ;  ++n) {
+    found = search(times[n], true, (n > 0 && times[n] >= times[n - 1]) ? found : m_size) ;
+    indices[n] = (ssize_t)found - 1 ;
+    }
+  }
+
+void data::TimeSeriesView::index_right(const double *times, const size_t count, size_t *indices) const
+/*--------------------------------------------------------------------------------------------------*/
+{
+  size_t found = m_size ;
+  for (size_t n = 0 ;  n < count ;  ++n) {
+    found = search(times[n], false, (n > 0 && times[n] >= times[n - 1]) ? found : m_size) ;
+    indices[n] = found ;
+    }
+  }
+
+data::TimeSeriesView data::TimeSeriesView::slice(const size_t pos, const ssize_t length) const
+/*------------------------------------------------------------------------------------------*/
+{
+  size_t first = std::min(pos, m_size) ;
+  size_t count = (length < 0) ? (m_size - first) : std::min((size_t)length, m_size - first) ;
+  if (m_times != nullptr) return TimeSeriesView(m_data + first, count, m_times + first) ;
+  else                    return TimeSeriesView(m_data + first, count, m_rate, time(first)) ;
+  }
+
+void data::TimeSeriesView::times(const size_t begin, const size_t end, double *times) const
+/*--------------------------------------------------------------------------------------*/
+{
+  if (m_times != nullptr) std::copy(m_times + begin, m_times + end, times) ;
+  else uniform_times(m_rate, m_start, begin, end, times) ;
+  }
+
+
 data::TimeSeries::TimeSeries()
 /*--------------------------*/
-: m_times(std::vector<double>()), m_data(std::vector<double>())
+: m_times(std::vector<double>()), m_data(std::vector<double>()), m_rate(0.0), m_start(0.0)
 {
   }
 
 data::TimeSeries::TimeSeries(const size_t size)
 /*-------------------------------------------*/
-: m_times(std::vector<double>(size)), m_data(std::vector<double>(size))
+: m_times(std::vector<double>(size)), m_data(std::vector<double>(size)), m_rate(0.0), m_start(0.0)
 {
   }
 
 data::TimeSeries::TimeSeries(const std::vector<double> &times, const std::vector<double> &data)
 /*-------------------------------------------------------------------------------------------*/
-: m_times(times), m_data(data)
+: m_times(times), m_data(data), m_rate(0.0), m_start(0.0)
 {
   assert(times.size() == data.size()) ;
   }
 
+data::TimeSeries::TimeSeries(std::vector<double> &&times, std::vector<double> &&data)
+/*---------------------------------------------------------------------------------*/
+: m_times(std::move(times)), m_data(std::move(data)), m_rate(0.0), m_start(0.0)
+{
+  assert(m_times.size() == m_data.size()) ;
+  }
+
 data::Point data::TimeSeries::point(const size_t n) const
 /*-----------------------------------------------------*/
 {
@@ -66,9 +221,45 @@ double data::TimeSeries::duration(void) const
 ssize_t data::TimeSeries::index(const double t)
 /*-------------------------------------------*/
 {
-  // Get iterator to first item not less than `t`.
-  auto lb = std::lower_bound(m_times.begin(), m_times.end(), t) ;
-  return (lb == m_times.end()) ? -1 : std::distance(m_times.begin(), lb) ;
+  return view().index(t) ;
+  }
+
+size_t data::TimeSeries::index_right(const double t) const
+/*------------------------------------------------------*/
+{
+  return view().index_right(t) ;
+  }
+
+void data::TimeSeries::index(const double *times, const size_t count, ssize_t *indices) const
+/*-----------------------------------------------------------------------------------------*/
+{
+  view().index(times, count, indices) ;
+  }
+
+void data::TimeSeries::index_right(const double *times, const size_t count, size_t *indices) const
+/*----------------------------------------------------------------------------------------------*/
+{
+  view().index_right(times, count, indices) ;
+  }
+
+data::TimeSeriesView data::TimeSeries::view(const size_t pos, const ssize_t length) const
+/*-------------------------------------------------------------------------------------*/
+{
+  if (m_rate > 0.0) return TimeSeriesView(m_data.data(), m_data.size(), m_rate, m_start).slice(pos, length) ;
+  else              return TimeSeriesView(m_data.data(), m_data.size(), m_times.data()).slice(pos, length) ;
+  }
+
+void data::TimeSeries::times(const size_t begin, const size_t end, double *times) const
+/*-----------------------------------------------------------------------------------*/
+{
+  if (m_rate > 0.0) uniform_times(m_rate, m_start, begin, end, times) ;
+  else std::copy(m_times.begin() + begin, m_times.begin() + end, times) ;
+  }
+
+void data::TimeSeries::values(const size_t begin, const size_t end, double *values) const
+/*--------------------------------------------------------------------------------------*/
+{
+  std::copy(m_data.begin() + begin, m_data.begin() + end, values) ;
   }
 
 
@@ -90,6 +281,16 @@ data::UniformTimeSeries::UniformTimeSeries(const double rate, const std::vector<
   m_start = start ;
   }
 
+data::UniformTimeSeries::UniformTimeSeries(const double rate, std::vector<double> &&data,
+/*-------------------------------------------------------------------------------------*/
+                                           const double start)
+: data::TimeSeries()
+{
+  m_data = std::move(data) ;
+  m_rate = rate ;
+  m_start = start ;
+  }
+
 data::UniformTimeSeries::UniformTimeSeries(const double rate, const size_t size,
 /*----------------------------------------------------------------------------*/
                                            const double start)
@@ -103,17 +304,42 @@ data::UniformTimeSeries::UniformTimeSeries(const double rate, const size_t size,
 data::Point data::UniformTimeSeries::point(const size_t n) const
 /*------------------------------------------------------------*/
 {
-  return data::Point((m_start + (double)n)/m_rate, m_data[n]) ;
+  return data::Point(m_start + (double)n/m_rate, m_data[n]) ;
   }
 
 double data::UniformTimeSeries::time(const size_t n) const
 /*------------------------------------------------------*/
 {
-  return (m_start + (double)n)/m_rate ;
+  return m_start + (double)n/m_rate ;
+  }
+
+
+data::MultiTimeSeries::MultiTimeSeries(std::vector<double> &&times, std::vector<double> &&data,
+/*-------------------------------------------------------------------------------------------*/
+                                       const size_t channels, const Layout layout)
+: m_times(std::move(times)), m_data(std::move(data)), m_channels(channels),
+  m_size(m_times.size()), m_layout(layout), m_rate(0.0), m_start(0.0)
+{
+  assert(m_data.size() == m_size*m_channels) ;
+  }
+
+data::MultiTimeSeries::MultiTimeSeries(const double rate, const double start, std::vector<double> &&data,
+/*-----------------------------------------------------------------------------------------------------*/
+                                       const size_t channels, const Layout layout)
+: m_data(std::move(data)), m_channels(channels),
+  m_size(channels ? m_data.size()/channels : 0), m_layout(layout), m_rate(rate), m_start(start)
+{
+  }
+
+double data::MultiTimeSeries::time(const size_t n) const
+/*----------------------------------------------------*/
+{
+  return (m_rate > 0.0) ? (m_start + (double)n/m_rate) : m_times[n] ;
   }
 
-ssize_t data::UniformTimeSeries::index(const double t)
-/*--------------------------------------------------*/
+void data::MultiTimeSeries::times(const size_t begin, const size_t end, double *times) const
+/*----------------------------------------------------------------------------------------*/
 {
-  return (t < m_start) ? -1 : (ssize_t)std::floor(m_rate*(t - m_start)) ;
+  if (m_rate > 0.0) uniform_times(m_rate, m_start, begin, end, times) ;
+  else std::copy(m_times.begin() + begin, m_times.begin() + end, times) ;
   }
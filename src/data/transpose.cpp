@@ -0,0 +1,204 @@
+/******************************************************************************
+ *                                                                            *
+ *  BioSignalML Management in C++                                             *
+ *                                                                            *
+ *  Copyright (c) 2010-2015  David Brooks                                     *
+ *                                                                            *
+ *  Licensed under the Apache License, Version 2.0 (the "License");           *
+ *  you may not use this file except in compliance with the License.          *
+ *  You may obtain a copy of the License at                                   *
+ *                                                                            *
+ *      http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                            *
+ *  Unless required by applicable law or agreed to in writing, software       *
+ *  distributed under the License is distributed on an "AS IS" BASIS,         *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ *  See the License for the specific language governing permissions and       *
+ *  limitations under the License.                                            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "transpose.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BSML_TRANSPOSE_X86
+#include <immintrin.h>
+#endif
+
+
+using namespace bsml ;
+
+// Blocks of channels and rows are transposed with SIMD registers, using the
+// widest instruction set the CPU supports, with scalar copies for the remainders.
+
+static void interleave_scalar(const double *const *planes, size_t channels, double *interleaved,
+/*--------------------------------------------------------------------------------------------*/
+                              size_t r0, size_t r1, size_t c0, size_t c1)
+{
+  for (size_t r = r0 ;  r < r1 ;  ++r) {
+    for (size_t c = c0 ;  c < c1 ;  ++c) interleaved[r*channels + c] = planes[c][r] ;
+    }
+  }
+
+static void deinterleave_scalar(const double *interleaved, size_t channels, double *const *planes,
+/*----------------------------------------------------------------------------------------------*/
+                                size_t r0, size_t r1, size_t c0, size_t c1)
+{
+  for (size_t r = r0 ;  r < r1 ;  ++r) {
+    for (size_t c = c0 ;  c < c1 ;  ++c) planes[c][r] = interleaved[r*channels + c] ;
+    }
+  }
+
+static void interleave_generic(const double *const *planes, size_t channels, size_t rows,
+/*-------------------------------------------------------------------------------------*/
+                               double *interleaved)
+{
+  interleave_scalar(planes, channels, interleaved, 0, rows, 0, channels) ;
+  }
+
+static void deinterleave_generic(const double *interleaved, size_t rows, size_t channels,
+/*-------------------------------------------------------------------------------------*/
+                                 double *const *planes)
+{
+  deinterleave_scalar(interleaved, channels, planes, 0, rows, 0, channels) ;
+  }
+
+
+#ifdef BSML_TRANSPOSE_X86
+
+// d[j][i] = s[i][j] for a 2x2 block.
+__attribute__((target("sse2")))
+static inline void transpose2_sse2(const double *s0, const double *s1, double *d0, double *d1)
+/*------------------------------------------------------------------------------------------*/
+{
+  __m128d a = _mm_loadu_pd(s0) ;
+  __m128d b = _mm_loadu_pd(s1) ;
+  _mm_storeu_pd(d0, _mm_unpacklo_pd(a, b)) ;
+  _mm_storeu_pd(d1, _mm_unpackhi_pd(a, b)) ;
+  }
+
+__attribute__((target("sse2")))
+static void interleave_sse2(const double *const *planes, size_t channels, size_t rows,
+/*----------------------------------------------------------------------------------*/
+                            double *interleaved)
+{
+  size_t rblock = rows & ~(size_t)1, cblock = channels & ~(size_t)1 ;
+  for (size_t r = 0 ;  r < rblock ;  r += 2) {
+    double *row = interleaved + r*channels ;
+    for (size_t c = 0 ;  c < cblock ;  c += 2)
+      transpose2_sse2(planes[c] + r, planes[c+1] + r, row + c, row + channels + c) ;
+    }
+  interleave_scalar(planes, channels, interleaved, 0, rblock, cblock, channels) ;
+  interleave_scalar(planes, channels, interleaved, rblock, rows, 0, channels) ;
+  }
+
+__attribute__((target("sse2")))
+static void deinterleave_sse2(const double *interleaved, size_t rows, size_t channels,
+/*---------------------------------------------------------------------------------*/
+                              double *const *planes)
+{
+  size_t rblock = rows & ~(size_t)1, cblock = channels & ~(size_t)1 ;
+  for (size_t r = 0 ;  r < rblock ;  r += 2) {
+    const double *row = interleaved + r*channels ;
+    for (size_t c = 0 ;  c < cblock ;  c += 2)
+      transpose2_sse2(row + c, row + channels + c, planes[c] + r, planes[c+1] + r) ;
+    }
+  deinterleave_scalar(interleaved, channels, planes, 0, rblock, cblock, channels) ;
+  deinterleave_scalar(interleaved, channels, planes, rblock, rows, 0, channels) ;
+  }
+
+
+// d[j][i] = s[i][j] for a 4x4 block.
+__attribute__((target("avx")))
+static inline void transpose4_avx(const double *s0, const double *s1, const double *s2, const double *s3,
+/*----------------------------------------------------------------------------------------------------*/
+                                  double *d0, double *d1, double *d2, double *d3)
+{
+  __m256d a = _mm256_loadu_pd(s0) ;
+  __m256d b = _mm256_loadu_pd(s1) ;
+  __m256d c = _mm256_loadu_pd(s2) ;
+  __m256d d = _mm256_loadu_pd(s3) ;
+  __m256d ab0 = _mm256_unpacklo_pd(a, b) ;   // a0 b0 a2 b2
+  __m256d ab1 = _mm256_unpackhi_pd(a, b) ;   // a1 b1 a3 b3
+  __m256d cd0 = _mm256_unpacklo_pd(c, d) ;
+  __m256d cd1 = _mm256_unpackhi_pd(c, d) ;
+  _mm256_storeu_pd(d0, _mm256_permute2f128_pd(ab0, cd0, 0x20)) ;
+  _mm256_storeu_pd(d1, _mm256_permute2f128_pd(ab1, cd1, 0x20)) ;
+  _mm256_storeu_pd(d2, _mm256_permute2f128_pd(ab0, cd0, 0x31)) ;
+  _mm256_storeu_pd(d3, _mm256_permute2f128_pd(ab1, cd1, 0x31)) ;
+  }
+
+__attribute__((target("avx")))
+static void interleave_avx(const double *const *planes, size_t channels, size_t rows,
+/*---------------------------------------------------------------------------------*/
+                           double *interleaved)
+{
+  size_t rblock = rows & ~(size_t)3, cblock = channels & ~(size_t)3 ;
+  for (size_t r = 0 ;  r < rblock ;  r += 4) {
+    double *row = interleaved + r*channels ;
+    for (size_t c = 0 ;  c < cblock ;  c += 4)
+      transpose4_avx(planes[c] + r, planes[c+1] + r, planes[c+2] + r, planes[c+3] + r,
+                     row + c, row + channels + c, row + 2*channels + c, row + 3*channels + c) ;
+    }
+  interleave_scalar(planes, channels, interleaved, 0, rblock, cblock, channels) ;
+  interleave_scalar(planes, channels, interleaved, rblock, rows, 0, channels) ;
+  }
+
+__attribute__((target("avx")))
+static void deinterleave_avx(const double *interleaved, size_t rows, size_t channels,
+/*---------------------------------------------------------------------------------*/
+                             double *const *planes)
+{
+  size_t rblock = rows & ~(size_t)3, cblock = channels & ~(size_t)3 ;
+  for (size_t r = 0 ;  r < rblock ;  r += 4) {
+    const double *row = interleaved + r*channels ;
+    for (size_t c = 0 ;  c < cblock ;  c += 4)
+      transpose4_avx(row + c, row + channels + c, row + 2*channels + c, row + 3*channels + c,
+                     planes[c] + r, planes[c+1] + r, planes[c+2] + r, planes[c+3] + r) ;
+    }
+  deinterleave_scalar(interleaved, channels, planes, 0, rblock, cblock, channels) ;
+  deinterleave_scalar(interleaved, channels, planes, rblock, rows, 0, channels) ;
+  }
+
+#endif
+
+
+typedef void (*InterleaveFunction)(const double *const *, size_t, size_t, double *) ;
+typedef void (*DeinterleaveFunction)(const double *, size_t, size_t, double *const *) ;
+
+static InterleaveFunction select_interleave(void)
+/*---------------------------------------------*/
+{
+#ifdef BSML_TRANSPOSE_X86
+  __builtin_cpu_init() ;
+  if (__builtin_cpu_supports("avx")) return interleave_avx ;
+  if (__builtin_cpu_supports("sse2")) return interleave_sse2 ;
+#endif
+  return interleave_generic ;
+  }
+
+static DeinterleaveFunction select_deinterleave(void)
+/*-------------------------------------------------*/
+{
+#ifdef BSML_TRANSPOSE_X86
+  __builtin_cpu_init() ;
+  if (__builtin_cpu_supports("avx")) return deinterleave_avx ;
+  if (__builtin_cpu_supports("sse2")) return deinterleave_sse2 ;
+#endif
+  return deinterleave_generic ;
+  }
+
+
+void data::interleave(const double *const *planes, size_t channels, size_t rows, double *interleaved)
+/*-------------------------------------------------------------------------------------------------*/
+{
+  static const InterleaveFunction function = select_interleave() ;
+  function(planes, channels, rows, interleaved) ;
+  }
+
+void data::deinterleave(const double *interleaved, size_t rows, size_t channels, double *const *planes)
+/*---------------------------------------------------------------------------------------------------*/
+{
+  static const DeinterleaveFunction function = select_deinterleave() ;
+  function(interleaved, rows, channels, planes) ;
+  }
@@ -0,0 +1,47 @@
+/******************************************************************************
+ *                                                                            *
+ *  BioSignalML Management in C++                                             *
+ *                                                                            *
+ *  Copyright (c) 2010-2015  David Brooks                                     *
+ *                                                                            *
+ *  Licensed under the Apache License, Version 2.0 (the "License");           *
+ *  you may not use this file except in compliance with the License.          *
+ *  You may obtain a copy of the License at                                   *
+ *                                                                            *
+ *      http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                            *
+ *  Unless required by applicable law or agreed to in writing, software       *
+ *  distributed under the License is distributed on an "AS IS" BASIS,         *
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ *  See the License for the specific language governing permissions and       *
+ *  limitations under the License.                                            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef BSML_TRANSPOSE_H
+#define BSML_TRANSPOSE_H
+
+#include <biosignalml/biosignalml_export.h>
+
+#include <cstddef>
+
+
+namespace bsml {
+
+  namespace data {
+
+    //! Interleave `rows` points from each of `channels` planar buffers, so that
+    //! `interleaved[r*channels + c] = planes[c][r]`.
+    BIOSIGNALML_EXPORT void interleave(const double *const *planes, size_t channels, size_t rows,
+                                       double *interleaved) ;
+
+    //! De-interleave `rows` rows of `channels` points into planar buffers, so that
+    //! `planes[c][r] = interleaved[r*channels + c]`.
+    BIOSIGNALML_EXPORT void deinterleave(const double *interleaved, size_t rows, size_t channels,
+                                         double *const *planes) ;
+
+    } ;
+
+  } ;
+
+#endif
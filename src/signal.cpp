@@ -63,3 +63,16 @@ bsml::data::TimeSeries::Ptr bsml::Signal::read(size_t pos, ssize_t length)
 {
   return data::TimeSeries::create() ;
   }
+
+bsml::data::UniformTimeSeries::Ptr bsml::Signal::read_decimated(bsml::Interval::Ptr interval, double rate)
+/*-----------------------------------------------------------------------------------------------------*/
+{
+  return data::UniformTimeSeries::create() ;
+  }
+
+bsml::data::UniformTimeSeries::Ptr bsml::Signal::read_resampled(bsml::Interval::Ptr interval, double rate,
+/*-----------------------------------------------------------------------------------------------------*/
+                                                                data::Interpolation method)
+{
+  return data::UniformTimeSeries::create() ;
+  }
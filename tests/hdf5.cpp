@@ -22,9 +22,11 @@
 #include <biosignalml/biosignalml.h>
 
 #include <typeinfo>
+#include <type_traits>
 #include <iostream>
 #include <string>
 #include <vector>
+#include <thread>
 #include <cmath>
 #include <cassert>
 
@@ -126,8 +128,166 @@ int main(int argc, char *argv[])
     }
   signals->extend(data, NPOINTS*NSIGS) ;
 
+  // All channels are read together, either interleaved or channel-major
+  auto block = signals->read(1, 3) ;
+  assert(block->size() == 3 && block->channels() == NSIGS) ;
+  assert(block->data()[NSIGS] == 2 && block->value(2, 1) == 103 && block->time(0) == times[1]) ;
+  auto planar = signals->read(bsml::Interval::create(rdf::URI(), 0.25, 0.5), -1,
+                              bsml::data::MultiTimeSeries::Layout::CHANNEL_MAJOR) ;
+  assert(planar->size() == 3 && planar->data()[3] == 101 && planar->value(2, 2) == 203) ;
+
+  // Channel-planar buffers are written and read directly
+  double planes[NSIGS][NPOINTS] ;
+  double *channels[NSIGS] = { planes[0], planes[1], planes[2] } ;
+  assert(signals->read(0, NPOINTS, channels) == NPOINTS) ;
+  assert(planes[0][4] == 4 && planes[2][1] == 201) ;
+
+  // Signals are found by URI
+  const std::string second = signals->at(1)->uri().to_string() ;
+  assert(signals->index(second) == 1 && signals->index("unknown") == -1) ;
+  assert((*signals)[second] == signals->at(1) && (*signals)["unknown"] == nullptr) ;
+  bsml::HDF5::SignalArray reordered ;      // Positions follow additions and removals
+  reordered.push_back(signals->at(2)) ;
+  reordered.push_back(signals->at(1)) ;
+  assert(reordered.index(second) == 1) ;
+  reordered.erase(reordered.begin()) ;
+  assert(reordered.index(second) == 0 && reordered[second] == signals->at(1)) ;
+  reordered.clear() ;
+  assert(reordered.index(second) == -1 && reordered.empty()) ;
+
+  // A subset of channels is read with one selection on their dataset
+  auto subset = hdf5.read_signals({ signals->at(2)->uri().to_string(), signals->at(0)->uri().to_string() }, 3) ;
+  assert(subset.size() == 2 && subset[0]->size() == 2) ;
+  assert(subset[0]->point(1).value() == 204 && subset[1]->point(0).value() == 3 && subset[1]->time(1) == times[4]) ;
+  auto span = bsml::Interval::create(rdf::URI(), 0.0, 1.0) ;   // All five points, decimated to two bins
+  auto outline = signals->read(span, 4) ;
+  assert(outline->size() == 4 && outline->value(2, 2) == 203 && outline->time(1) == times[1] && outline->time(3) == times[4]) ;
+  auto outlines = hdf5.read_signals({ signals->at(2)->uri().to_string(), signals->at(0)->uri().to_string() }, span, 4) ;
+  assert(outlines[0]->size() == 4 && outlines[0]->point(1).value() == 202 && outlines[1]->time(2) == times[3]) ;
+
+  // Signals defined as a batch flush the file once
+  hdf5.begin_definitions() ;
+  auto batch1 = hdf5.new_signal("batch 1", rdf::URI("http://units.org/mV"), 100.0) ;
+  auto batch2 = hdf5.new_signal("batch 2", rdf::URI("http://units.org/mV"), 100.0) ;
+  hdf5.end_definitions() ;
+  batch2->extend(points, 10) ;
+  assert(batch2->read(0, -1)->size() == 10) ;
+
+  // Appends can be written on a background thread
+  hdf5.set_async_writes(8) ;
+  for (int n = 0 ;  n < 20 ;  ++n) sig->extend(points, 10) ;
+  hdf5.sync() ;
+  assert(sig->read(205, 5)->point(4).value() == 0) ;
+  bool refused = false ;
+  std::thread other([&]() {   // Only the first thread to append may queue appends
+    try { sig->extend(points, 10) ; }
+    catch (const bsml::HDF5::Exception &e) { refused = true ; }
+    }) ;
+  other.join() ;
+  assert(refused) ;
+  hdf5.set_async_writes(0) ;
+
+  // Overview reads of a long signal come from its summary pyramid
+  bsml::HDF5::StorageOptions summarised ;
+  summarised.pyramid_levels = 3 ;
+  summarised.pyramid_factor = 4 ;
+  hdf5.set_storage_options(summarised) ;
+  auto wave = hdf5.new_signal("wave", rdf::URI("http://units.org/mV"), 100.0) ;
+  hdf5.set_storage_options(bsml::HDF5::StorageOptions()) ;
+  for (int n = 0 ;  n < 100 ;  ++n) wave->extend(points, 10) ;
+  auto whole = bsml::Interval::create(rdf::URI(), 0.0, 10.0) ;
+  auto envelope = wave->read_envelope(whole, 10) ;
+  assert(envelope->size() > 0 && envelope->size() <= 10 && envelope->channels() == 3) ;
+  assert(envelope->value(0, 0) == 0 && envelope->value(0, 1) == 4
+         && envelope->value(0, 2) > 0 && envelope->value(0, 2) < 4) ;
+  auto overview = wave->read(whole, 20) ;
+  assert(overview->size() > 0 && overview->size() <= 20 && overview->point(1).value() == 4) ;
+  for (size_t n = 1 ;  n < overview->size() ;  ++n) assert(overview->time(n) > overview->time(n - 1)) ;
+
+  // Decimation filters out the wave's 10 Hz cycle, leaving its mean
+  auto slow = wave->read_decimated(whole, 5.0) ;
+  assert(slow->size() == 50 && std::fabs(slow->point(25).value() - 2.0) < 0.01) ;
+  auto fast = wave->read_resampled(bsml::Interval::create(rdf::URI(), 0.0, 0.1), 200.0) ;
+  assert(fast->size() == 21 && fast->point(1).value() == 0.5 && fast->time(1) == 0.005) ;
+
+  // Windows of a read are views of its points, which can also be read into a buffer
+  auto series = wave->read(0, 100) ;
+  auto window = series->view(20, 10) ;
+  assert(window.size() == 10 && window.data() == series->data().data() + 20 && window.time(0) == 0.2) ;
+  assert(window.slice(5).value(0) == 4 && window.index(0.255) == 5 && window.slice(8, 5).size() == 2) ;
+  double buffer[10] ;
+  auto direct = wave->read_view(20, 10, buffer) ;
+  assert(direct.data() == buffer && direct.value(3) == 3 && direct.time(9) == window.time(9)) ;
+
+  // Points are iterated, and times copied in batches, without a virtual call per point
+  static_assert(std::is_trivially_copyable<bsml::data::Point>::value, "Point is a plain value") ;
+  double total = 0.0 ;
+  for (auto const &p : *series) total += p.value() ;
+  assert(total == 200.0) ;
+  double stamps[4] ;
+  series->times(96, 100, stamps) ;
+  assert(stamps[0] == series->time(96) && stamps[3] == series->point(99).time()) ;
+
+  // Points are found either side of a time, singly or for a batch of ascending times
+  bsml::data::TimeSeries clocked({ 0.0, 0.1, 0.1, 0.25, 0.4 }, { 1, 2, 3, 4, 5 }) ;
+  assert(clocked.index(0.1) == 2 && clocked.index_right(0.1) == 1) ;
+  assert(clocked.index(-1.0) == -1 && clocked.index_right(1.0) == 5 && series->index(0.555) == 55) ;
+  double queries[] = { 0.05, 0.25, 0.3 } ;
+  ssize_t found[3] ;
+  clocked.index(queries, 3, found) ;
+  assert(found[0] == 0 && found[1] == 3 && found[2] == 3) ;
+
+  // Statistics and percentiles of a signal are found a block of points at a time
+  auto summary = wave->statistics(whole) ;
+  assert(summary.count() == 1000 && summary.min() == 0 && summary.max() == 4) ;
+  assert(std::fabs(summary.mean() - 2.0) < 1e-12 && std::fabs(summary.variance() - 2.0) < 1e-12) ;
+  assert(wave->percentile(whole, 50.0) == 2.0 && wave->percentile(whole, 100.0) == 4.0) ;
+  assert(bsml::data::statistics(window).max() == 4 && bsml::data::percentile(*series, 25.0) == 1.0) ;
+
+  // With chunk summaries only the partial chunks at either end of a range are read
+  bsml::HDF5::StorageOptions chunked ;
+  chunked.chunk_summaries = true ;
+  chunked.chunk_shape = { 16 } ;
+  hdf5.set_storage_options(chunked) ;
+  auto tally = hdf5.new_signal("tally", rdf::URI("http://units.org/mV"), 100.0) ;
+  hdf5.set_storage_options(bsml::HDF5::StorageOptions()) ;
+  for (int n = 0 ;  n < 100 ;  ++n) tally->extend(points, 10) ;
+  assert(tally->storage_options().chunk_summaries) ;
+  auto totals = tally->statistics(whole) ;
+  assert(totals.count() == 1000 && totals.min() == 0 && totals.max() == 4) ;
+  assert(std::fabs(totals.mean() - 2.0) < 1e-12 && std::fabs(totals.variance() - 2.0) < 1e-9) ;
+  auto part = tally->statistics(3, 50) ;
+  assert(part.count() == 50 && std::fabs(part.mean() - wave->statistics(3, 50).mean()) < 1e-12) ;
+  auto sketch = tally->read(whole, 8) ;    // No pyramid, so every point is read
+  assert(sketch->size() == 8 && sketch->point(0).value() == 0 && sketch->point(1).value() == 4) ;
+
 //  std::cout << "STORED: " << hdf5.serialise_metadata(rdf::Graph::Format::TURTLE) << std::endl ;
   hdf5.close() ;  // Should automatically update metadata...
+  assert(tally->minValue() == 0 && tally->maxValue() == 4) ;
+
+  // Once SWMR writing starts points are still appended, but nothing can be defined
+  auto live = bsml::HDF5::Recording(rdf::URI("http://ex.org/live"), "live.h5", true,
+                                    bsml::HDF5::ChunkCache(), true) ;
+  auto livesig = live.new_signal("signal", rdf::URI("http://units.org/mV"), 100.0) ;
+  live.start_swmr_write() ;
+  bool defined = true ;
+  try {
+    live.new_signal("late", rdf::URI("http://units.org/mV"), 100.0) ;
+    }
+  catch (bsml::HDF5::Exception e) {
+    defined = false ;
+    }
+  assert(!defined) ;
+  auto follow = livesig->cursor() ;
+  livesig->extend(points, 10) ;
+  live.flush() ;
+  assert(livesig->read(0, -1)->size() == 10) ;
+
+  // A cursor returns just the points appended since it last polled
+  assert(follow.poll()->size() == 10 && follow.poll(0.01)->size() == 0) ;
+  livesig->extend(points, 3) ;
+  assert(follow.poll()->point(2).value() == 2 && follow.position() == 13) ;
+  live.close() ;
 
 
   try {
@@ -20,9 +20,13 @@
 
 #include <iostream>
 #include <vector>
+#include <cmath>
+#include <cassert>
 
 #include <biosignalml/data/hdf5.h>
 #include "data/hdf5impl.h"
+#include "data/transpose.h"
+#include "data/resample.h"
 
 
 using namespace bsml ;
@@ -59,6 +63,116 @@ int main(void)
 //    std::cout << c.name() << std::endl ;
 //    c->extend(testdata) ;
 //    h->store_metadata("metadata", "format") ;
+
+    // A clock's sparse time index is kept in memory until saved, in a group
+    // apart from the clocks
+    assert(c->index(3.5) == 2 && c->index_right(3.5) == 3) ;
+    assert(!c->get_dataset().attrExists("index")) ;
+    c->save_index() ;
+    assert(c->get_dataset().openGroup("/recording/clock").getNumObjs() == 1) ;
+    H5::DataSet index = c->get_dataset().openDataSet(BSML_H5_CLOCK_INDEX_GROUP "/0") ;
+    assert(index.getSpace().getSimpleExtentNpoints() == 1) ;
+
+    // Buffered appends are coalesced and only written on a whole buffer or flush()
+    auto b = h->create_signal("signal 3", "mV", nullptr, 0, std::vector<hsize_t>(), 1.0, 0.0, 1000.0) ;
+    b->set_buffer_size(10000) ;
+    for (int n = 0 ;  n < 1000 ;  ++n) b->extend(testdata, 6, 1) ;
+    assert(b->size() == 6000) ;
+    assert(b->get_dataset().getSpace().getSimpleExtentNpoints() == 0) ;
+    auto points = b->read(5994, -1) ;    // Reading flushes the buffer
+    assert(points.size() == 6 && points[0] == 1.0 && points[5] == 6.0) ;
+    assert(b->get_dataset().getSpace().getSimpleExtentNpoints() == 6000) ;
+    b->extend(testdata, 6, 1) ;
+    b->flush() ;
+    assert(b->get_dataset().getSpace().getSimpleExtentNpoints() == 6006) ;
+
+    // Errors writing buffered data as a dataset is destroyed go to its error handler
+    std::vector<std::string> errors ;
+    {
+      auto lost = h->create_signal("signal 7", "mV", nullptr, 0, std::vector<hsize_t>(), 1.0, 0.0, 1000.0) ;
+      lost->set_buffer_size(1000) ;
+      lost->set_error_handler([&errors](const std::string &error) { errors.push_back(error) ; }) ;
+      lost->extend(testdata, 6, 1) ;
+      H5Dclose(lost->get_dataset().getId()) ;  // So the final write fails
+      }
+    assert(errors.size() == 1) ;
+
+    // A buffer smaller than a row still buffers a chunk, and long appends only
+    // write whole buffers directly, keeping later writes aligned
+    HDF5::StorageOptions hundreds ;
+    hundreds.chunk_shape = { 100 } ;
+    auto aligned = h->create_signal("signal 8", "mV", nullptr, 0, std::vector<hsize_t>(), 1.0, 0.0, 1000.0,
+                                    nullptr, hundreds) ;
+    aligned->set_buffer_size(1, HDF5::BSML_H5_BUFFER_BYTES) ;
+    std::vector<double> ramp(250, 1.0) ;
+    aligned->extend(ramp.data(), 250, 1) ;
+    assert(aligned->get_dataset().getSpace().getSimpleExtentNpoints() == 200 && aligned->size() == 250) ;
+    aligned->extend(ramp.data(), 30, 1) ;
+    assert(aligned->get_dataset().getSpace().getSimpleExtentNpoints() == 200) ;
+
+    // Read straight into our own buffer
+    double window[8] ;
+    assert(b->read(6000, 8, window) == 6) ;
+    assert(window[0] == 1.0 && window[5] == 6.0) ;
+
+    // Storage options are recovered from the dataset's filters
+    auto z = h->create_signal("signal 4", "mV", testdata, 6, std::vector<hsize_t>(), 1.0, 0.0, 1000.0,
+                              nullptr, HDF5::StorageOptions(HDF5::BSML_H5_COMPRESS_GZIP, 6, true)) ;
+    HDF5::StorageOptions options = z->storage_options() ;
+    assert(options.compression == HDF5::BSML_H5_COMPRESS_GZIP && options.level == 6 && options.shuffle) ;
+    assert(b->storage_options().compression == HDF5::BSML_H5_COMPRESS_GZIP && !b->storage_options().shuffle) ;
+
+    // Chunks default to BSML_H5_CHUNK_BYTES of whole rows
+    assert(options.chunk_shape.size() == 1 && options.chunk_shape[0] == BSML_H5_CHUNK_BYTES/sizeof(double)) ;
+    options.chunk_shape = { 100 } ;
+    auto e = h->create_signal("signal 5", "mV", testdata, 6, std::vector<hsize_t>(), 1.0, 0.0, 1000.0,
+                              nullptr, options) ;
+    assert(e->chunk_rows() == 100) ;
+
+    // Chunk cache use is counted for each dataset
+    z->read(0, 6) ;
+    z->read(2, 2) ;
+    assert(z->cache_statistics().misses == 1 && z->cache_statistics().hits == 1) ;
+
+    // Physical values are quantised to the stored type using gain and offset
+    HDF5::StorageOptions narrow ;
+    narrow.datatype = HDF5::BSML_H5_INT16 ;
+    auto q = h->create_signal("signal 6", "mV", testdata, 6, std::vector<hsize_t>(), 0.5, 1.0, 1000.0,
+                              nullptr, narrow) ;
+    int16_t raw[6] ;
+    assert(q->read(0, 6, raw) == 6 && raw[0] == 0 && raw[5] == 10) ;
+    assert(q->read(0, -1)[3] == 4.0) ;
+    bool rejected = false ;
+    double missing = NAN ;
+    try { q->extend(&missing, 1, 1) ; }
+    catch (const HDF5::Exception &e) { rejected = true ; }
+    assert(rejected && q->size() == 6) ;
+
+    // Planar buffers are interleaved in blocks, with any remainders copied singly
+    std::vector<double> planar(6*9), interleaved(6*9), result(6*9) ;
+    std::vector<const double *> from(6) ;
+    std::vector<double *> to(6) ;
+    for (int n = 0 ;  n < 6*9 ;  ++n) planar[n] = n ;
+    for (int c = 0 ;  c < 6 ;  ++c) {
+      from[c] = planar.data() + 9*c ;
+      to[c] = result.data() + 9*c ;
+      }
+    data::interleave(from.data(), 6, 9, interleaved.data()) ;
+    assert(interleaved[7*6 + 5] == planar[5*9 + 7] && interleaved[8*6 + 1] == planar[1*9 + 8]) ;
+    data::deinterleave(interleaved.data(), 9, 6, to.data()) ;
+    assert(result == planar) ;
+
+    // Resampled values are interpolated between points, and filtered ones keep a constant
+    double times[] = { 0.0, 1.0, 3.0 }, values[] = { 0.0, 10.0, 30.0 }, resampled[6] ;
+    data::interpolate(times, values, 3, 0.5, 1.0, 4, data::Interpolation::LINEAR, resampled) ;
+    assert(resampled[0] == 5.0 && resampled[2] == 25.0 && resampled[3] == 30.0) ;
+    data::interpolate(times, values, 3, 0.5, 1.0, 4, data::Interpolation::NEAREST, resampled) ;
+    assert(resampled[0] == 0.0 && resampled[1] == 10.0 && resampled[2] == 30.0) ;
+    data::Resampler resampler(2.5) ;
+    std::vector<double> level(2*resampler.half_width() + 20, 7.0) ;
+    resampler.resample(level.data(), resampler.half_width(), 6, resampled) ;
+    assert(std::fabs(resampled[3] - 7.0) < 1e-12 && std::fabs(resampled[5] - 7.0) < 1e-12) ;
+
     h->close() ;
 
     delete h ;